@@ -42,7 +42,7 @@ CircleHostInterface* CircleHostInterface::instance;
 uint8_t* fakeFrameBuffer = nullptr;
 #endif
 
-void Faux86::log(Faux86::LogChannel channel, const char* message, ...)
+void Faux86::hostLog(Faux86::LogChannel channel, const char* message, ...)
 {
 #if (USE_SERIAL_LOGGING || FAKE_FRAMEBUFFER)
 	va_list myargs;
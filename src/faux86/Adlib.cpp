@@ -74,5 +74,5 @@ void Adlib::init()
 {
 	uint16_t baseport = vm.config.adlib.port;
 	vm.ports.setPortRedirector(baseport, baseport + 1, this);
-	OPL3_Reset(&opl3, vm.config.audio.sampleRate);
+	OPL3_Reset(&opl3, nativeSampleRate);
 }
@@ -39,6 +39,9 @@ namespace Faux86
 
 		int16_t generateSample() override;
 
+		// OPL3 runs from a 14.318MHz crystal divided by 288
+		static constexpr uint32_t nativeSampleRate = 49716;
+
 		// on the Sound Blaster Pro, ports (base+0) and (base+1) are for
 		// the OPL FM music chips, and are also mirrored at (base+8) (base+9)
 		// as well as 0x388 and 0x389 to remain compatible with the older adlib cards
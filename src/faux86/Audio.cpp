@@ -70,11 +70,38 @@ bool Audio::isAudioBufferFilled()
 void Audio::tick() 
 {
 	int16_t sample;
+
+	// The Blaster and Sound Source have DMA, IRQ and FIFO side effects so
+	// they are clocked even while the output buffer is full
+	blasterResampler.setRates(vm.blaster.samplerate ? vm.blaster.samplerate : sampleRate, sampleRate);
+	for (int n = blasterResampler.advance(); n > 0; n--)
+	{
+		if (vm.blaster.samplerate > 0)
+			vm.blaster.tick();
+		blasterResampler.push(vm.blaster.generateSample());
+	}
+
+	for (int n = soundSourceResampler.advance(); n > 0; n--)
+	{
+		vm.soundSource.tick();
+		soundSourceResampler.push(vm.soundSource.generateSample());
+	}
+
+	// The speaker is timed by its event timestamps, so it is advanced a sample
+	// per tick whether or not there is room for the output
+	int16_t speakerSample = vm.pcSpeaker.generateSample();
+
 	if (audbufptr >= usebuffersize) return;
-	sample = vm.adlib.generateSample() >> 8;
-	if (vm.config.useDisneySoundSource) sample += vm.soundSource.generateSample();
-	sample += vm.blaster.generateSample();
-	if (vm.pcSpeaker.enabled) sample += (vm.pcSpeaker.generateSample() >> 1);
+
+	for (int n = adlibResampler.advance(); n > 0; n--)
+	{
+		adlibResampler.push(vm.adlib.generateSample());
+	}
+
+	sample = adlibResampler.filter() >> 8;
+	if (vm.config.useDisneySoundSource) sample += soundSourceResampler.filter();
+	sample += blasterResampler.filter();
+	sample += (speakerSample >> 1);
 	if (audbufptr < (int) sizeof(audbuf) ) audbuf[audbufptr++] = (uint8_t) ((uint16_t) sample+128);
 }
 
@@ -103,6 +130,9 @@ void Audio::init()
 	vm.timing.gensamplerate = sampleRate;
 	doublesamplecount = (uint32_t) ( (double) sampleRate * (double) 0.01);
 
+	adlibResampler.setRates(Adlib::nativeSampleRate, sampleRate);
+	soundSourceResampler.setRates(DisneySoundSource::sampleRate, sampleRate);
+
 	MemUtils::memset (audbuf, 128, sizeof (audbuf) );
 	audbufptr = usebuffersize;
 
@@ -21,6 +21,7 @@
 
 #pragma once
 #include "Types.h"
+#include "AudioResampler.h"
 
 namespace Faux86
 {
@@ -49,6 +50,10 @@ namespace Faux86
 	private:
 		void createOutputWAV(char *filename);
 
+		AudioResampler adlibResampler;
+		AudioResampler blasterResampler;
+		AudioResampler soundSourceResampler;
+
 		int32_t latency = 0;
 		int8_t audbuf[96000];
 		int32_t audbufptr = 0;
@@ -0,0 +1,312 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "AudioResampler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+using namespace Faux86;
+
+static constexpr double FilterCutoff = 0.42;	// Of the input rate
+
+// 128 phase x 16 tap Blackman windowed sinc, cutoff at 0.42 of the input
+// rate, Q15 with each phase normalised to unity gain. Tap 7 is the centre
+// at phase 0, giving a fixed latency of 8 input samples. Used whenever the
+// output rate is at least the input rate.
+static const int16_t filterTable[1 << 7][16] =
+{
+	{ -8, -14, 211, -802, 1925, -3406, 4716, 27524, 4716, -3406, 1925, -802, 211, -14, -8, 0 },
+	{ -7, -17, 215, -805, 1911, -3341, 4498, 27525, 4935, -3471, 1938, -799, 207, -12, -9, 0 },
+	{ -7, -19, 219, -807, 1896, -3275, 4283, 27518, 5156, -3534, 1951, -796, 202, -10, -9, 0 },
+	{ -6, -21, 223, -808, 1881, -3209, 4069, 27508, 5379, -3597, 1963, -793, 197, -8, -10, 0 },
+	{ -6, -23, 227, -809, 1865, -3141, 3857, 27491, 5603, -3659, 1974, -788, 192, -5, -10, 0 },
+	{ -5, -25, 231, -810, 1848, -3073, 3647, 27473, 5829, -3720, 1984, -784, 187, -3, -11, 0 },
+	{ -5, -27, 234, -811, 1831, -3005, 3438, 27453, 6056, -3780, 1993, -779, 182, 0, -12, 0 },
+	{ -4, -29, 237, -810, 1813, -2936, 3232, 27425, 6285, -3839, 2002, -774, 176, 2, -12, 0 },
+	{ -4, -30, 240, -810, 1794, -2866, 3028, 27393, 6515, -3897, 2010, -768, 171, 5, -13, 0 },
+	{ -4, -32, 243, -809, 1775, -2796, 2826, 27360, 6746, -3954, 2016, -762, 165, 8, -14, 0 },
+	{ -3, -34, 246, -808, 1755, -2726, 2626, 27319, 6979, -4009, 2023, -755, 159, 10, -14, 0 },
+	{ -3, -36, 248, -807, 1734, -2655, 2428, 27279, 7213, -4064, 2028, -748, 153, 13, -15, 0 },
+	{ -2, -37, 251, -805, 1713, -2584, 2232, 27231, 7448, -4117, 2032, -740, 146, 16, -16, 0 },
+	{ -2, -39, 253, -803, 1692, -2512, 2038, 27181, 7684, -4170, 2035, -732, 140, 19, -16, 0 },
+	{ -1, -40, 255, -800, 1670, -2440, 1847, 27125, 7921, -4221, 2038, -724, 133, 22, -17, 0 },
+	{ -1, -42, 257, -797, 1647, -2368, 1658, 27066, 8160, -4270, 2040, -715, 126, 25, -18, 0 },
+	{ -1, -43, 259, -794, 1624, -2295, 1471, 27003, 8399, -4318, 2040, -705, 119, 27, -18, 0 },
+	{ 0, -44, 260, -790, 1600, -2223, 1286, 26936, 8640, -4365, 2040, -696, 112, 31, -19, 0 },
+	{ 0, -46, 262, -786, 1576, -2150, 1104, 26865, 8881, -4411, 2039, -685, 105, 34, -20, 0 },
+	{ 0, -47, 263, -782, 1552, -2077, 925, 26791, 9123, -4455, 2037, -675, 97, 37, -21, 0 },
+	{ 1, -48, 264, -778, 1527, -2004, 747, 26711, 9366, -4497, 2034, -663, 90, 40, -22, 0 },
+	{ 1, -49, 265, -773, 1502, -1931, 573, 26629, 9609, -4538, 2029, -652, 82, 43, -22, 0 },
+	{ 1, -50, 266, -768, 1476, -1858, 400, 26543, 9853, -4578, 2024, -639, 74, 46, -23, 1 },
+	{ 1, -51, 267, -762, 1450, -1785, 230, 26452, 10098, -4616, 2018, -627, 66, 50, -24, 1 },
+	{ 2, -52, 267, -756, 1423, -1712, 63, 26359, 10343, -4652, 2011, -614, 57, 53, -25, 1 },
+	{ 2, -53, 268, -750, 1396, -1639, -102, 26259, 10589, -4686, 2003, -600, 49, 56, -25, 1 },
+	{ 2, -54, 268, -744, 1369, -1566, -264, 26158, 10835, -4719, 1994, -586, 40, 60, -26, 1 },
+	{ 2, -55, 268, -737, 1342, -1494, -424, 26053, 11082, -4750, 1984, -572, 32, 63, -27, 1 },
+	{ 3, -55, 268, -731, 1314, -1421, -581, 25945, 11328, -4780, 1973, -557, 23, 66, -28, 1 },
+	{ 3, -56, 268, -723, 1286, -1349, -735, 25831, 11575, -4807, 1961, -542, 14, 70, -29, 1 },
+	{ 3, -57, 268, -716, 1258, -1277, -887, 25717, 11823, -4833, 1947, -526, 4, 73, -30, 1 },
+	{ 3, -57, 267, -709, 1229, -1205, -1036, 25597, 12070, -4857, 1933, -510, -5, 77, -30, 1 },
+	{ 3, -58, 267, -701, 1200, -1133, -1182, 25472, 12317, -4879, 1918, -493, -14, 81, -31, 1 },
+	{ 3, -58, 266, -693, 1171, -1062, -1326, 25346, 12565, -4898, 1901, -476, -24, 84, -32, 1 },
+	{ 4, -59, 265, -684, 1142, -991, -1466, 25214, 12812, -4916, 1884, -459, -34, 88, -33, 1 },
+	{ 4, -59, 264, -676, 1113, -920, -1605, 25082, 13059, -4932, 1865, -441, -44, 91, -34, 1 },
+	{ 4, -60, 263, -667, 1083, -850, -1740, 24944, 13306, -4946, 1846, -422, -54, 95, -35, 1 },
+	{ 4, -60, 262, -658, 1054, -780, -1873, 24800, 13553, -4958, 1825, -403, -64, 99, -35, 2 },
+	{ 4, -60, 261, -649, 1024, -711, -2003, 24658, 13799, -4968, 1803, -384, -74, 102, -36, 2 },
+	{ 4, -61, 260, -640, 994, -642, -2130, 24510, 14045, -4975, 1780, -364, -84, 106, -37, 2 },
+	{ 4, -61, 258, -630, 964, -574, -2254, 24360, 14291, -4981, 1756, -344, -95, 110, -38, 2 },
+	{ 4, -61, 257, -621, 934, -506, -2376, 24207, 14536, -4984, 1731, -324, -105, 113, -39, 2 },
+	{ 4, -61, 255, -611, 903, -439, -2494, 24051, 14780, -4985, 1705, -303, -116, 117, -40, 2 },
+	{ 4, -61, 253, -601, 873, -372, -2610, 23889, 15024, -4984, 1678, -281, -127, 121, -40, 2 },
+	{ 4, -61, 251, -591, 843, -306, -2723, 23726, 15267, -4980, 1649, -260, -137, 125, -41, 2 },
+	{ 4, -61, 249, -581, 812, -240, -2833, 23560, 15510, -4974, 1620, -238, -148, 128, -42, 2 },
+	{ 4, -61, 247, -570, 782, -176, -2941, 23391, 15751, -4966, 1590, -215, -159, 132, -43, 2 },
+	{ 4, -61, 245, -560, 752, -111, -3045, 23219, 15992, -4956, 1558, -192, -171, 136, -44, 2 },
+	{ 5, -61, 243, -549, 721, -48, -3147, 23043, 16232, -4943, 1525, -169, -182, 139, -44, 3 },
+	{ 5, -61, 240, -538, 691, 15, -3246, 22863, 16471, -4927, 1492, -145, -193, 143, -45, 3 },
+	{ 5, -61, 238, -527, 660, 77, -3342, 22683, 16708, -4909, 1457, -121, -204, 147, -46, 3 },
+	{ 5, -61, 236, -516, 630, 138, -3435, 22500, 16945, -4889, 1421, -97, -216, 151, -47, 3 },
+	{ 4, -60, 233, -505, 600, 199, -3526, 22315, 17180, -4866, 1384, -72, -227, 154, -48, 3 },
+	{ 4, -60, 230, -494, 570, 259, -3613, 22125, 17415, -4841, 1346, -47, -239, 158, -48, 3 },
+	{ 4, -60, 228, -483, 540, 318, -3698, 21934, 17647, -4813, 1307, -22, -250, 162, -49, 3 },
+	{ 4, -60, 225, -472, 510, 376, -3780, 21742, 17879, -4783, 1267, 4, -262, 165, -50, 3 },
+	{ 4, -59, 222, -460, 480, 433, -3859, 21543, 18109, -4750, 1226, 30, -273, 169, -50, 3 },
+	{ 4, -59, 219, -449, 451, 490, -3936, 21346, 18337, -4715, 1184, 56, -285, 173, -51, 3 },
+	{ 4, -58, 216, -437, 421, 545, -4009, 21144, 18564, -4676, 1141, 83, -297, 176, -52, 3 },
+	{ 4, -58, 213, -426, 392, 600, -4080, 20942, 18790, -4636, 1096, 109, -309, 180, -53, 4 },
+	{ 4, -58, 210, -414, 363, 654, -4148, 20734, 19013, -4592, 1051, 137, -320, 183, -53, 4 },
+	{ 4, -57, 207, -402, 334, 707, -4213, 20525, 19235, -4546, 1005, 164, -332, 187, -54, 4 },
+	{ 4, -57, 203, -391, 305, 759, -4275, 20316, 19455, -4497, 958, 192, -344, 190, -54, 4 },
+	{ 4, -56, 200, -379, 276, 810, -4335, 20105, 19674, -4446, 909, 220, -356, 193, -55, 4 },
+	{ 4, -56, 197, -367, 248, 860, -4392, 19890, 19890, -4392, 860, 248, -367, 197, -56, 4 },
+	{ 4, -55, 193, -356, 220, 909, -4446, 19674, 20105, -4335, 810, 276, -379, 200, -56, 4 },
+	{ 4, -54, 190, -344, 192, 958, -4497, 19455, 20316, -4275, 759, 305, -391, 203, -57, 4 },
+	{ 4, -54, 187, -332, 164, 1005, -4546, 19235, 20525, -4213, 707, 334, -402, 207, -57, 4 },
+	{ 4, -53, 183, -320, 137, 1051, -4592, 19013, 20734, -4148, 654, 363, -414, 210, -58, 4 },
+	{ 4, -53, 180, -309, 109, 1096, -4636, 18790, 20942, -4080, 600, 392, -426, 213, -58, 4 },
+	{ 3, -52, 176, -297, 83, 1141, -4676, 18564, 21144, -4009, 545, 421, -437, 216, -58, 4 },
+	{ 3, -51, 173, -285, 56, 1184, -4715, 18337, 21346, -3936, 490, 451, -449, 219, -59, 4 },
+	{ 3, -50, 169, -273, 30, 1226, -4750, 18109, 21543, -3859, 433, 480, -460, 222, -59, 4 },
+	{ 3, -50, 165, -262, 4, 1267, -4783, 17879, 21742, -3780, 376, 510, -472, 225, -60, 4 },
+	{ 3, -49, 162, -250, -22, 1307, -4813, 17647, 21934, -3698, 318, 540, -483, 228, -60, 4 },
+	{ 3, -48, 158, -239, -47, 1346, -4841, 17415, 22125, -3613, 259, 570, -494, 230, -60, 4 },
+	{ 3, -48, 154, -227, -72, 1384, -4866, 17180, 22315, -3526, 199, 600, -505, 233, -60, 4 },
+	{ 3, -47, 151, -216, -97, 1421, -4889, 16945, 22500, -3435, 138, 630, -516, 236, -61, 5 },
+	{ 3, -46, 147, -204, -121, 1457, -4909, 16708, 22683, -3342, 77, 660, -527, 238, -61, 5 },
+	{ 3, -45, 143, -193, -145, 1492, -4927, 16471, 22863, -3246, 15, 691, -538, 240, -61, 5 },
+	{ 3, -44, 139, -182, -169, 1525, -4943, 16232, 23043, -3147, -48, 721, -549, 243, -61, 5 },
+	{ 2, -44, 136, -171, -192, 1558, -4956, 15992, 23219, -3045, -111, 752, -560, 245, -61, 4 },
+	{ 2, -43, 132, -159, -215, 1590, -4966, 15751, 23391, -2941, -176, 782, -570, 247, -61, 4 },
+	{ 2, -42, 128, -148, -238, 1620, -4974, 15510, 23560, -2833, -240, 812, -581, 249, -61, 4 },
+	{ 2, -41, 125, -137, -260, 1649, -4980, 15267, 23726, -2723, -306, 843, -591, 251, -61, 4 },
+	{ 2, -40, 121, -127, -281, 1678, -4984, 15024, 23889, -2610, -372, 873, -601, 253, -61, 4 },
+	{ 2, -40, 117, -116, -303, 1705, -4985, 14780, 24051, -2494, -439, 903, -611, 255, -61, 4 },
+	{ 2, -39, 113, -105, -324, 1731, -4984, 14536, 24207, -2376, -506, 934, -621, 257, -61, 4 },
+	{ 2, -38, 110, -95, -344, 1756, -4981, 14291, 24360, -2254, -574, 964, -630, 258, -61, 4 },
+	{ 2, -37, 106, -84, -364, 1780, -4975, 14045, 24510, -2130, -642, 994, -640, 260, -61, 4 },
+	{ 2, -36, 102, -74, -384, 1803, -4968, 13799, 24658, -2003, -711, 1024, -649, 261, -60, 4 },
+	{ 2, -35, 99, -64, -403, 1825, -4958, 13553, 24800, -1873, -780, 1054, -658, 262, -60, 4 },
+	{ 1, -35, 95, -54, -422, 1846, -4946, 13306, 24944, -1740, -850, 1083, -667, 263, -60, 4 },
+	{ 1, -34, 91, -44, -441, 1865, -4932, 13059, 25082, -1605, -920, 1113, -676, 264, -59, 4 },
+	{ 1, -33, 88, -34, -459, 1884, -4916, 12812, 25214, -1466, -991, 1142, -684, 265, -59, 4 },
+	{ 1, -32, 84, -24, -476, 1901, -4898, 12565, 25346, -1326, -1062, 1171, -693, 266, -58, 3 },
+	{ 1, -31, 81, -14, -493, 1918, -4879, 12317, 25472, -1182, -1133, 1200, -701, 267, -58, 3 },
+	{ 1, -30, 77, -5, -510, 1933, -4857, 12070, 25597, -1036, -1205, 1229, -709, 267, -57, 3 },
+	{ 1, -30, 73, 4, -526, 1947, -4833, 11823, 25717, -887, -1277, 1258, -716, 268, -57, 3 },
+	{ 1, -29, 70, 14, -542, 1961, -4807, 11575, 25831, -735, -1349, 1286, -723, 268, -56, 3 },
+	{ 1, -28, 66, 23, -557, 1973, -4780, 11328, 25945, -581, -1421, 1314, -731, 268, -55, 3 },
+	{ 1, -27, 63, 32, -572, 1984, -4750, 11082, 26053, -424, -1494, 1342, -737, 268, -55, 2 },
+	{ 1, -26, 60, 40, -586, 1994, -4719, 10835, 26158, -264, -1566, 1369, -744, 268, -54, 2 },
+	{ 1, -25, 56, 49, -600, 2003, -4686, 10589, 26259, -102, -1639, 1396, -750, 268, -53, 2 },
+	{ 1, -25, 53, 57, -614, 2011, -4652, 10343, 26359, 63, -1712, 1423, -756, 267, -52, 2 },
+	{ 1, -24, 50, 66, -627, 2018, -4616, 10098, 26452, 230, -1785, 1450, -762, 267, -51, 1 },
+	{ 1, -23, 46, 74, -639, 2024, -4578, 9853, 26543, 400, -1858, 1476, -768, 266, -50, 1 },
+	{ 0, -22, 43, 82, -652, 2029, -4538, 9609, 26629, 573, -1931, 1502, -773, 265, -49, 1 },
+	{ 0, -22, 40, 90, -663, 2034, -4497, 9366, 26711, 747, -2004, 1527, -778, 264, -48, 1 },
+	{ 0, -21, 37, 97, -675, 2037, -4455, 9123, 26791, 925, -2077, 1552, -782, 263, -47, 0 },
+	{ 0, -20, 34, 105, -685, 2039, -4411, 8881, 26865, 1104, -2150, 1576, -786, 262, -46, 0 },
+	{ 0, -19, 31, 112, -696, 2040, -4365, 8640, 26936, 1286, -2223, 1600, -790, 260, -44, 0 },
+	{ 0, -18, 27, 119, -705, 2040, -4318, 8399, 27003, 1471, -2295, 1624, -794, 259, -43, -1 },
+	{ 0, -18, 25, 126, -715, 2040, -4270, 8160, 27066, 1658, -2368, 1647, -797, 257, -42, -1 },
+	{ 0, -17, 22, 133, -724, 2038, -4221, 7921, 27125, 1847, -2440, 1670, -800, 255, -40, -1 },
+	{ 0, -16, 19, 140, -732, 2035, -4170, 7684, 27181, 2038, -2512, 1692, -803, 253, -39, -2 },
+	{ 0, -16, 16, 146, -740, 2032, -4117, 7448, 27231, 2232, -2584, 1713, -805, 251, -37, -2 },
+	{ 0, -15, 13, 153, -748, 2028, -4064, 7213, 27279, 2428, -2655, 1734, -807, 248, -36, -3 },
+	{ 0, -14, 10, 159, -755, 2023, -4009, 6979, 27319, 2626, -2726, 1755, -808, 246, -34, -3 },
+	{ 0, -14, 8, 165, -762, 2016, -3954, 6746, 27360, 2826, -2796, 1775, -809, 243, -32, -4 },
+	{ 0, -13, 5, 171, -768, 2010, -3897, 6515, 27393, 3028, -2866, 1794, -810, 240, -30, -4 },
+	{ 0, -12, 2, 176, -774, 2002, -3839, 6285, 27425, 3232, -2936, 1813, -810, 237, -29, -4 },
+	{ 0, -12, 0, 182, -779, 1993, -3780, 6056, 27453, 3438, -3005, 1831, -811, 234, -27, -5 },
+	{ 0, -11, -3, 187, -784, 1984, -3720, 5829, 27473, 3647, -3073, 1848, -810, 231, -25, -5 },
+	{ 0, -10, -5, 192, -788, 1974, -3659, 5603, 27491, 3857, -3141, 1865, -809, 227, -23, -6 },
+	{ 0, -10, -8, 197, -793, 1963, -3597, 5379, 27508, 4069, -3209, 1881, -808, 223, -21, -6 },
+	{ 0, -9, -10, 202, -796, 1951, -3534, 5156, 27518, 4283, -3275, 1896, -807, 219, -19, -7 },
+	{ 0, -9, -12, 207, -799, 1938, -3471, 4935, 27525, 4498, -3341, 1911, -805, 215, -17, -7 },
+};
+
+// sin() for the filter design, as bare metal builds have no maths library.
+// Reduces to [-pi/2, pi/2] and uses the Taylor series, which is accurate
+// to well below the Q15 resolution of the taps there
+static double sine(double x)
+{
+	const double pi = 3.14159265358979323846;
+
+	x -= 2 * pi * (double)(int64_t)(x / (2 * pi));
+	if (x > pi)
+		x -= 2 * pi;
+	else if (x < -pi)
+		x += 2 * pi;
+	if (x > pi / 2)
+		x = pi - x;
+	else if (x < -pi / 2)
+		x = -pi - x;
+
+	double x2 = x * x;
+	double term = x;
+	double sum = x;
+	for (int n = 1; n < 10; n++)
+	{
+		term *= -x2 / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+AudioResampler::~AudioResampler()
+{
+	delete[] downsampleTable;
+}
+
+// Same design as filterTable, with the cutoff scaled by outputRate / inputRate
+void AudioResampler::buildDownsampleTable()
+{
+	const double pi = 3.14159265358979323846;
+	double cutoff = FilterCutoff * outputRate / inputRate;
+
+	if (!downsampleTable)
+		downsampleTable = new int16_t[Phases][Taps];
+
+	for (int phase = 0; phase < Phases; phase++)
+	{
+		double taps[Taps];
+		double total = 0;
+
+		for (int n = 0; n < Taps; n++)
+		{
+			double t = n - (Taps / 2 - 1) - (double)phase / Phases;
+			double x = 2 * pi * cutoff * t;
+			double sinc = (t == 0) ? 1.0 : sine(x) / x;
+			double window = 0.42 + 0.5 * sine(pi * t / (Taps / 2) + pi / 2) + 0.08 * sine(2 * pi * t / (Taps / 2) + pi / 2);
+
+			taps[n] = sinc * window;
+			total += taps[n];
+		}
+
+		// Normalise for unity gain, putting the rounding error on the largest tap
+		int32_t sum = 0;
+		int largest = 0;
+		for (int n = 0; n < Taps; n++)
+		{
+			double value = taps[n] * 32768 / total;
+			downsampleTable[phase][n] = (int16_t)(value < 0 ? value - 0.5 : value + 0.5);
+			sum += downsampleTable[phase][n];
+			if (downsampleTable[phase][n] > downsampleTable[phase][largest])
+				largest = n;
+		}
+		downsampleTable[phase][largest] += (int16_t)(32768 - sum);
+	}
+}
+
+void AudioResampler::setRates(uint32_t newInputRate, uint32_t newOutputRate)
+{
+	if (newInputRate == inputRate && newOutputRate == outputRate && table)
+		return;
+
+	inputRate = newInputRate;
+	outputRate = newOutputRate;
+	step = outputRate ? ((uint64_t)inputRate << 32) / outputRate : 0;
+
+	if (outputRate && inputRate > outputRate)
+	{
+		buildDownsampleTable();
+		table = downsampleTable;
+	}
+	else
+	{
+		table = filterTable;
+	}
+}
+
+int AudioResampler::advance()
+{
+	uint64_t position = (uint64_t)phase + step;
+	phase = (uint32_t)position;
+	return (int)(position >> 32);
+}
+
+void AudioResampler::push(int16_t sample)
+{
+	history[writePos] = history[writePos + Taps] = sample;
+	writePos = (writePos + 1) & (Taps - 1);
+}
+
+int16_t AudioResampler::filter() const
+{
+	const int16_t* samples = &history[writePos];
+	const int16_t* coeffs = (table ? table : filterTable)[phase >> (32 - PhaseBits)];
+	int32_t sum;
+
+#if defined(RESAMPLER_SSE2)
+	__m128i acc = _mm_add_epi32(
+		_mm_madd_epi16(_mm_loadu_si128((const __m128i*) samples), _mm_loadu_si128((const __m128i*) coeffs)),
+		_mm_madd_epi16(_mm_loadu_si128((const __m128i*) (samples + 8)), _mm_loadu_si128((const __m128i*) (coeffs + 8))));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm_cvtsi128_si32(acc);
+#elif defined(RESAMPLER_NEON)
+	int32x4_t acc = vmull_s16(vld1_s16(samples), vld1_s16(coeffs));
+	acc = vmlal_s16(acc, vld1_s16(samples + 4), vld1_s16(coeffs + 4));
+	acc = vmlal_s16(acc, vld1_s16(samples + 8), vld1_s16(coeffs + 8));
+	acc = vmlal_s16(acc, vld1_s16(samples + 12), vld1_s16(coeffs + 12));
+	int32x2_t pair = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	sum = vget_lane_s32(vpadd_s32(pair, pair), 0);
+#else
+	sum = 0;
+	for (int n = 0; n < Taps; n++)
+	{
+		sum += (int32_t)samples[n] * coeffs[n];
+	}
+#endif
+
+	sum >>= 15;
+	if (sum > 32767)
+		return 32767;
+	if (sum < -32768)
+		return -32768;
+	return (int16_t)sum;
+}
@@ -0,0 +1,64 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include "Types.h"
+
+namespace Faux86
+{
+	// Polyphase windowed-sinc resampler used by the mixer to bring a device
+	// running at its native sample rate up (or down) to the output rate.
+	// Input samples are pulled from the device as the output clock advances,
+	// so the device stays locked to the audio stream rather than host time.
+	class AudioResampler
+	{
+	public:
+		~AudioResampler();
+
+		void setRates(uint32_t inputRate, uint32_t outputRate);
+
+		// Advance by one output sample and return how many new input samples are needed
+		int advance();
+		void push(int16_t sample);
+		int16_t filter() const;
+
+	private:
+		static constexpr int Taps = 16;
+		static constexpr int PhaseBits = 7;
+		static constexpr int Phases = 1 << PhaseBits;
+
+		void buildDownsampleTable();
+
+		// The shared table when upsampling, or one with its cutoff lowered to the
+		// output rate when downsampling so nothing above it folds back
+		const int16_t (*table)[Taps] = nullptr;
+		int16_t (*downsampleTable)[Taps] = nullptr;
+
+		uint32_t inputRate = 0;
+		uint32_t outputRate = 0;
+		uint64_t step = 0;
+		uint32_t phase = 0;
+
+		// History is stored twice so the newest Taps samples are always contiguous
+		int16_t history[Taps * 2] = { 0 };
+		int writePos = 0;
+	};
+}
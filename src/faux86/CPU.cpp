@@ -1175,6 +1175,8 @@ void CPU::intcall86 (uint8_t intnum)
 	switch (intnum) {
 			case 0x10:
 				vm.video.updatedscreen = 1;
+				if (vm.config.videoHLE && vm.video.handleTextServices())
+					return;
 				/*if (regs.byteregs[regah]!=0x0E) {
 					printf("Int 10h AX = %04X\n", regs.wordregs[regax]);
 				}*/
@@ -1217,12 +1219,12 @@ void CPU::intcall86 (uint8_t intnum)
 
 				if ((regs.byteregs[regah] == 0x11))
 				{
-					log(Log, "Character generator");
+					log(LogVerbose, "Character generator");
 				}
 
 				if ((regs.byteregs[regah] == 0x13))
 				{
-					log(Log, "Write string");
+					log(LogVerbose, "Write string");
 				}
 
 				if ((regs.byteregs[regah] == 0x12) && (regs.byteregs[regbl] == 0x10))
@@ -1230,7 +1232,7 @@ void CPU::intcall86 (uint8_t intnum)
 					//if (vm.debugger)
 					//	vm.debugger->logCallstack();
 
-					log(Log, "Vid config");
+					log(LogVerbose, "Vid config");
 					regs.byteregs[regbh] = 0;
 					regs.byteregs[regbl] = 3;
 					regs.byteregs[regch] = 0x08;
@@ -3565,7 +3567,7 @@ void CPU::exec86 (uint32_t execloops)
 						intcall86 (6); /* trip invalid opcode exception (this occurs on the 80186+, 8086/8088 CPUs treat them as NOPs. */
 						               /* technically they aren't exactly like NOPs in most cases, but for our pursoses, that's accurate enough. */
 #endif
-						if (vm.config.verbose) {
+						if (Logging::isEnabled(LogVerbose)) {
 								log (LogVerbose, "Illegal opcode: %02X %02X /%X @ %04X:%04X\n", getmem8(savecs, saveip), getmem8(savecs, saveip+1), (getmem8(savecs, saveip+2) >> 3) & 7, savecs, saveip);
 							}
 						break;
@@ -99,6 +99,17 @@ void showhelp () {
 		"  -resw # -resh #  Force a constant window size in pixels.\n"
 		"  -smooth          Apply smoothing to screen rendering.\n"
 		"  -noscale         Disable 2x scaling of low resolution video modes.\n"
+		"  -raster          Render graphics modes a scanline at a time as the beam\n"
+		"                   reaches them, for mid-frame video effects.\n"
+		"  -refresh #       Target display refresh in Hz. Frames are drawn at the guest's\n"
+		"                   vertical retrace and skipped if emulation falls behind.\n"
+		"  -renderondemand  Only render frames when the host asks for one.\n"
+		"  -videohle        Handle BIOS text output, scrolling and write string calls\n"
+		"                   natively instead of running the video ROM code.\n"
+		"  -diskcache #     Size of the disk sector cache in KB, 0 to disable.\n"
+		"                   (default: 512)\n"
+		"  -capture file    Record the display to a file as palette indexed deltas.\n"
+		"                   Convert it to PNG images with tools/capture2png.\n"
 		"  -ssource         Enable Disney Sound Source emulation on LPT1.\n"
 		"  -latency #       Change audio buffering and output latency. (default: 100 ms)\n"
 		"  -samprate #      Change audio emulation sample rate. (default: 48000 Hz)\n"
@@ -192,6 +203,14 @@ void Config::parseCommandLine(int argc, char *argv[])
 					i++;
 					videoRomFile = hostSystemInterface->openFile(argv[i]);
 				}
+			else if (strcmpi (argv[i], "-capture") ==0) {
+					i++;
+					captureFile = hostSystemInterface->createFile(argv[i]);
+				}
+			else if (strcmpi (argv[i], "-diskcache") ==0) {
+					i++;
+					diskCacheSize = (uint32_t) atol (argv[i]);
+				}
 			else if (strcmpi (argv[i], "-resw") ==0) {
 					i++;
 					constantw = (uint16_t) atoi (argv[i]);
@@ -211,6 +230,14 @@ void Config::parseCommandLine(int argc, char *argv[])
 			else if (strcmpi (argv[i], "-verbose") ==0) verbose = 1;
 			else if (strcmpi (argv[i], "-smooth") ==0) noSmooth = false;
 			else if (strcmpi (argv[i], "-fps") ==0) renderBenchmark = 1;
+			else if (strcmpi (argv[i], "-raster") ==0) rasterMode = true;
+			else if (strcmpi (argv[i], "-videohle") ==0) videoHLE = true;
+			else if (strcmpi (argv[i], "-renderondemand") ==0) renderOnRequest = true;
+			else if (strcmpi (argv[i], "-refresh") ==0) {
+					i++;
+					refreshRate = (uint32_t) atol (argv[i]);
+					if (refreshRate == 0) refreshRate = 60;
+				}
 			else if (strcmpi (argv[i], "-nosound") ==0) enableAudio = false;
 			else if (strcmpi (argv[i], "-fullscreen") ==0) useFullScreen = true;
 			else if (strcmpi (argv[i], "-delay") ==0) frameDelay = atol (argv[++i]);
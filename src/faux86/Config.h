@@ -78,12 +78,29 @@
 #define OUTPUT_FRAMEBUFFER_HEIGHT 400
 
 #define DEFAULT_RAM_SIZE 0x100000
+
+//size in KB of the cache of disk sectors kept between INT 13h calls
+#define DEFAULT_DISK_CACHE_SIZE 512
 						 
 //#define DEBUG_BLASTER
 //#define DEBUG_DMA
 
+//when VERIFY_PLANAR_CONVERSION is defined, every line converted by the table
+//driven EGA/VGA planar renderer is compared against the original per-pixel
+//code and any mismatch is logged. this is slow, only enable it for testing.
+//#define VERIFY_PLANAR_CONVERSION
+
 //#define BENCHMARK_BIOS
 
+//when BENCHMARK_MEMUTILS is defined, the MemUtils copy and fill routines are
+//timed against plain byte loops at startup and the results are logged.
+//#define BENCHMARK_MEMUTILS
+
+//LOG_MIN_LEVEL strips whole log channels out at compile time: 0 keeps everything,
+//1 removes the verbose channels (LogVerbose and LogRaw) and 2 keeps only fatal
+//errors. channels that are compiled in can still be switched off at runtime.
+#define LOG_MIN_LEVEL 0
+
 #include "Types.h"
 #include "HostSystemInterface.h"
 
@@ -116,6 +133,7 @@ namespace Faux86
 		DiskInterface* romBasicFile = nullptr;
 		DiskInterface* videoRomFile = nullptr;
 		DiskInterface* asciiFile = nullptr;
+		DiskInterface* captureFile = nullptr;
 
 		DiskInterface* diskDriveA = nullptr;
 		DiskInterface* diskDriveB = nullptr;
@@ -123,6 +141,7 @@ namespace Faux86
 		DiskInterface* diskDriveD = nullptr;
 
 		uint8_t bootDrive = 0;
+		uint32_t diskCacheSize = DEFAULT_DISK_CACHE_SIZE;	// KB
 
 		struct  
 		{
@@ -134,6 +153,8 @@ namespace Faux86
 		{
 			uint16_t port = 0x220;
 			uint8_t irq = 7;
+			uint8_t dma = 1;
+			uint8_t highDma = 5;
 		} blaster;
 
 		struct  
@@ -154,6 +175,9 @@ namespace Faux86
 		bool renderBenchmark = false;
 		bool noSmooth = true;
 		bool noScale = false;
+		bool rasterMode = false;
+		bool videoHLE = false;
+		bool renderOnRequest = false;
 		bool enableAudio = true;
 		bool enableConsole = false;
 		bool singleThreaded = true;
@@ -162,6 +186,7 @@ namespace Faux86
 		
 		uint32_t speed = 0;
 		uint32_t frameDelay = 20;
+		uint32_t refreshRate = 60;
 
 	};
 }
@@ -30,60 +30,117 @@ using namespace Faux86;
 
 uint8_t DMA::read (uint8_t channel) 
 {
-	uint8_t ret;
-	if (channels[channel].masked) return (128);
-	if (channels[channel].autoinit && (channels[channel].count > channels[channel].reload) ) channels[channel].count = 0;
-	if (channels[channel].count > channels[channel].reload) return (128);
-	//if (channels[channel].direction) ret = RAM[channels[channel].page + channels[channel].addr + channels[channel].count];
-	//	else ret = RAM[channels[channel].page + channels[channel].addr - channels[channel].count];
-	if (channels[channel].direction == 0)
-	{
-		ret = vm.memory.RAM[channels[channel].page + channels[channel].addr + channels[channel].count];
-	}
-	else
+	uint8_t ret = 128;
+	readBlock(channel, &ret, 1);
+	return (ret);
+}
+
+uint32_t DMA::readBlock(uint8_t channelIndex, uint8_t* buffer, uint32_t length)
+{
+	Channel& channel = channels[channelIndex];
+	uint32_t ramSize = vm.config.ramSize;
+
+	// Channels 4-7 move 16-bit words, addressed in words within a 128K page
+	uint32_t width = channelIndex >= 4 ? 2 : 1;
+	uint32_t pageBase = channelIndex >= 4 ? channel.page & 0xFE0000 : channel.page;
+	uint32_t units = length / width;
+	uint32_t transferred = 0;
+
+	if (channel.masked) return 0;
+
+	while (transferred < units)
 	{
-		ret = vm.memory.RAM[channels[channel].page + channels[channel].addr - channels[channel].count];
+		if (channel.count > channel.reload)
+		{
+			if (!channel.autoinit) break;
+			channel.count = 0;
+		}
+
+		// Each span runs to the terminal count or the edge of the page,
+		// whichever comes first
+		uint32_t span = units - transferred;
+		uint32_t remaining = channel.reload - channel.count + 1;
+		uint32_t offset, pageSpace;
+
+		if (channel.direction == 0)
+		{
+			offset = (channel.addr + channel.count) & 0xFFFF;
+			pageSpace = 0x10000 - offset;
+		}
+		else
+		{
+			offset = (channel.addr - channel.count) & 0xFFFF;
+			pageSpace = offset + 1;
+		}
+		if (span > remaining) span = remaining;
+		if (span > pageSpace) span = pageSpace;
+
+		uint32_t addr32 = pageBase + offset * width;
+		uint8_t* dest = buffer + transferred * width;
+
+		if (channel.direction == 0 && addr32 + span * width <= ramSize)
+		{
+			MemUtils::memcpy(dest, &vm.memory.RAM[addr32], span * width);
+		}
+		else
+		{
+			for (uint32_t n = 0; n < span; n++)
+			{
+				uint32_t source = channel.direction == 0 ? addr32 + n * width : addr32 - n * width;
+				for (uint32_t b = 0; b < width; b++)
+				{
+					*dest++ = (source + b) < ramSize ? vm.memory.RAM[source + b] : 0xFF;
+				}
+			}
+		}
+
+		channel.count += span;
+		transferred += span;
+
+		if (channel.count > channel.reload)
+		{
+			status[channelIndex >> 2] |= 1 << (channelIndex & 3);
+		}
 	}
-	channels[channel].count++;
-	return (ret);
+
+	return transferred * width;
 }
 
-bool DMA::portWriteHandler(uint16_t addr, uint8_t value)
+void DMA::writeController(uint8_t controller, uint8_t reg, uint8_t value)
 {
 	uint8_t channel;
+	uint8_t& flipflop = flipflops[controller];
+
+	if (reg < 8)
+	{
+		// Address and count registers, written low byte then high byte
+		Channel& target = channels[controller * 4 + (reg >> 1)];
+		uint32_t& field = (reg & 1) ? target.reload : target.addr;
+
+		if (flipflop == 1) field = (field & 0x00FF) | ( (uint32_t) value << 8);
+		else field = (field & 0xFF00) | value;
+
+		if ( (reg & 1) && flipflop == 1) {
+				if (target.reload == 0) target.reload = 65536;
+				target.count = 0;
+			}
 #ifdef DEBUG_DMA
-	printf ("out8237(0x%X, %X);\n", addr, value);
-#endif
-	switch (addr) {
-			case 0x2: //channel 1 address register
-				if (flipflop == 1) channels[1].addr = (channels[1].addr & 0x00FF) | ( (uint32_t) value << 8);
-				else channels[1].addr = (channels[1].addr & 0xFF00) | value;
-#ifdef DEBUG_DMA
-				if (flipflop == 1) printf ("[NOTICE] DMA channel 1 address register = %04X\n", channels[1].addr);
-#endif
-				flipflop = ~flipflop & 1;
-				break;
-			case 0x3: //channel 1 count register
-				if (flipflop == 1) channels[1].reload = (channels[1].reload & 0x00FF) | ( (uint32_t) value << 8);
-				else channels[1].reload = (channels[1].reload & 0xFF00) | value;
-				if (flipflop == 1) {
-						if (channels[1].reload == 0) channels[1].reload = 65536;
-						channels[1].count = 0;
-#ifdef DEBUG_DMA
-						printf ("[NOTICE] DMA channel 1 reload register = %04X\n", channels[1].reload);
+		if (flipflop == 1) printf ("[NOTICE] DMA channel %u %s register = %04X\n", controller * 4 + (reg >> 1), (reg & 1) ? "reload" : "address", field);
 #endif
-					}
-				flipflop = ~flipflop & 1;
-				break;
+		flipflop = ~flipflop & 1;
+		return;
+	}
+
+	switch (reg) {
 			case 0xA: //write single mask register
-				channel = value & 3;
+				channel = controller * 4 + (value & 3);
 				channels[channel].masked = (value >> 2) & 1;
 #ifdef DEBUG_DMA
 				printf ("[NOTICE] DMA channel %u masking = %u\n", channel, channels[channel].masked);
 #endif
 				break;
 			case 0xB: //write mode register
-				channel = value & 3;
+				channel = controller * 4 + (value & 3);
 				channels[channel].direction = (value >> 5) & 1;
 				channels[channel].autoinit = (value >> 4) & 1;
 				channels[channel].writemode = (value >> 2) & 1; //not quite accurate
@@ -98,13 +155,86 @@ bool DMA::portWriteHandler(uint16_t addr, uint8_t value)
 #endif
 				flipflop = 0;
 				break;
-			case 0x83: //DMA channel 1 page register
-				channels[1].page = (uint32_t) value << 16;
+			case 0xD: //master clear
+				flipflop = 0;
+				status[controller] = 0;
+				for (channel = 0; channel < 4; channel++)
+					channels[controller * 4 + channel].masked = 1;
+				break;
+			case 0xE: //clear mask register
+				for (channel = 0; channel < 4; channel++)
+					channels[controller * 4 + channel].masked = 0;
+				break;
+			case 0xF: //write all mask bits
+				for (channel = 0; channel < 4; channel++)
+					channels[controller * 4 + channel].masked = (value >> channel) & 1;
+				break;
+		}
+}
+
+uint8_t DMA::readController(uint8_t controller, uint8_t reg)
+{
+	uint8_t& flipflop = flipflops[controller];
+	uint8_t result;
+
+	if (reg < 8)
+	{
+		// Reads return the current address and remaining count
+		Channel& target = channels[controller * 4 + (reg >> 1)];
+		uint32_t current;
+		if (reg & 1) current = target.reload - target.count;
+		else if (target.direction == 0) current = target.addr + target.count;
+		else current = target.addr - target.count;
+
+		result = (uint8_t) (flipflop == 1 ? current >> 8 : current);
+		flipflop = ~flipflop & 1;
+		return result;
+	}
+
+	if (reg == 8) { //status register, terminal count bits clear on read
+			result = status[controller];
+			status[controller] = 0;
+			return result;
+		}
+
+	return 0;
+}
+
+bool DMA::portWriteHandler(uint16_t addr, uint8_t value)
+{
 #ifdef DEBUG_DMA
-				printf ("[NOTICE] DMA channel 1 page base = %05X\n", channels[1].page);
+	printf ("out8237(0x%X, %X);\n", addr, value);
 #endif
-				break;
+	if (addr < 0x10)
+	{
+		writeController (0, (uint8_t) addr, value);
+		return true;
+	}
+	if (addr >= 0xC0 && addr < 0xE0)
+	{
+		writeController (1, (uint8_t) ( (addr - 0xC0) >> 1), value);
+		return true;
+	}
+
+	// Page registers
+	int8_t channel = -1;
+	switch (addr) {
+			case 0x87: channel = 0; break;
+			case 0x83: channel = 1; break;
+			case 0x81: channel = 2; break;
+			case 0x82: channel = 3; break;
+			case 0x8F: channel = 4; break;
+			case 0x8B: channel = 5; break;
+			case 0x89: channel = 6; break;
+			case 0x8A: channel = 7; break;
 		}
+	if (channel >= 0)
+	{
+		channels[channel].page = (uint32_t) value << 16;
+#ifdef DEBUG_DMA
+		printf ("[NOTICE] DMA channel %u page base = %05X\n", channel, channels[channel].page);
+#endif
+	}
 	return true;
 }
 
@@ -113,20 +243,15 @@ bool DMA::portReadHandler(uint16_t addr, uint8_t& outValue)
 #ifdef DEBUG_DMA
 	printf ("in8237(0x%X);\n", addr);
 #endif
-	switch (addr) {
-		case 3:
-			if (flipflop == 1)
-			{
-				outValue = (channels[1].reload >> 8);
-				return true;
-			}
-			else
-			{
-				outValue = (channels[1].reload);
-				return true;
-			}
-			flipflop = ~flipflop & 1;
-			break;
+	if (addr < 0x10)
+	{
+		outValue = readController (0, (uint8_t) addr);
+		return true;
+	}
+	if (addr >= 0xC0 && addr < 0xE0)
+	{
+		outValue = readController (1, (uint8_t) ( (addr - 0xC0) >> 1) );
+		return true;
 	}
 
 	outValue = 0;
@@ -144,4 +269,5 @@ void DMA::init()
 
 	vm.ports.setPortRedirector(0x00, 0x0F, this);
 	vm.ports.setPortRedirector(0x80, 0x8F, this);
+	vm.ports.setPortRedirector(0xC0, 0xDF, this);
 }
@@ -36,10 +36,17 @@ namespace Faux86
 		void init();
 		uint8_t read(uint8_t channel);
 
+		// Copies up to length bytes from a channel into buffer. Auto-init
+		// channels wrap at terminal count, single cycle channels stop there.
+		// Returns the number of bytes transferred (0 if the channel is masked).
+		uint32_t readBlock(uint8_t channel, uint8_t* buffer, uint32_t length);
+
 		virtual bool portWriteHandler(uint16_t portnum, uint8_t value) override;
 		virtual bool portReadHandler(uint16_t portnum, uint8_t& outValue) override;
 
 	private:
+		void writeController(uint8_t controller, uint8_t reg, uint8_t value);
+		uint8_t readController(uint8_t controller, uint8_t reg);
 
 		struct Channel
 		{
@@ -53,11 +60,13 @@ namespace Faux86
 			uint8_t masked;
 		};
 
-		static constexpr int NumDMAChannels = 4;
+		// Channels 0-3 are the 8-bit controller, 4-7 the 16-bit one
+		static constexpr int NumDMAChannels = 8;
 
 		Channel channels[NumDMAChannels];
 		VM& vm;
-		uint8_t flipflop = 0;
+		uint8_t flipflops[2] = { 0, 0 };
+		uint8_t status[2] = { 0, 0 };
 	};
 
 }
@@ -38,6 +38,8 @@ namespace Faux86
 
 		int16_t generateSample() override;
 
+		static constexpr uint32_t sampleRate = 8000;
+
 		virtual bool portWriteHandler(uint16_t portnum, uint8_t value) override;
 		virtual bool portReadHandler(uint16_t portnum, uint8_t& outValue) override;
 
@@ -59,6 +59,8 @@ bool DriveManager::insertDisk(DriveTarget targetDrive, DiskInterface* disk)
 	}
 
 	drive.disk = disk;
+	drive.nextLBA = ~0u;
+	cache.invalidate(targetDrive);
 	uint64_t diskSize = disk->getSize();
 
 	if (targetDrive >= 0x80) 
@@ -121,29 +123,45 @@ void DriveManager::ejectDisk (DriveTarget drive)
 	{
 		delete drives[drive].disk;
 		drives[drive].disk = nullptr;
+		cache.invalidate(drive);
 	}
 }
 
 void DriveManager::readDisk (DriveTarget targetDrive, uint16_t dstseg, uint16_t dstoff, uint16_t cyl, uint16_t sect, uint16_t head, uint16_t sectcount)
 {
 	Drive& drive = drives[targetDrive];
-	uint32_t memdest, lba, fileoffset, cursect, sectoffset;
+	uint32_t memdest, lba, fileoffset, cursect;
 	if (!sect || !drive.disk) return;
 	lba = ((uint32_t)cyl * (uint32_t)drive.heads + (uint32_t)head) * (uint32_t)drive.sects + (uint32_t)sect - 1;
 	fileoffset = lba * 512;
 	if (fileoffset>drive.disk->getSize()) return;
 
-	drive.disk->seek(fileoffset);
+	// A request that carries on from the last one is probably a file being
+	// loaded, so misses also pull in the whole of the following track
+	bool sequential = (lba == drive.nextLBA);
+
 	memdest = ((uint32_t)dstseg << 4) + (uint32_t)dstoff;
-	//for the readdisk function, we need to use write86 instead of directly fread'ing into
-	//the RAM array, so that read-only flags are honored. otherwise, a program could load
-	//data from a disk over BIOS or other ROM code that it shouldn't be able to.
+	//sectors go through writeBlock instead of straight into the RAM array, so that
+	//read-only flags are honored. otherwise, a program could load data from a disk
+	//over BIOS or other ROM code that it shouldn't be able to.
 	for (cursect = 0; cursect<sectcount; cursect++) {
-		if (drive.disk->read(sectorbuffer, 512) < 512) break;
-		for (sectoffset = 0; sectoffset<512; sectoffset++) {
-			vm.memory.writeByte(memdest++, sectorbuffer[sectoffset]);
+		uint32_t sectorLBA = lba + cursect;
+		uint32_t readAhead = sectcount - cursect - 1;
+		if (drive.sects)
+		{
+			uint32_t toTrackEnd = drive.sects - 1 - sectorLBA % drive.sects;
+			if (toTrackEnd > readAhead)
+				readAhead = toTrackEnd;
+			if (sequential)
+				readAhead += drive.sects;
 		}
+
+		const uint8_t* sector = cache.read(targetDrive, drive.disk, sectorLBA, readAhead);
+		if (!sector) break;
+		vm.memory.writeBlock(memdest, sector, 512);
+		memdest += 512;
 	}
+	drive.nextLBA = lba + cursect;
 
 	vm.cpu.regs.byteregs[regal] = cursect;
 	vm.cpu.cf = 0;
@@ -153,7 +171,7 @@ void DriveManager::readDisk (DriveTarget targetDrive, uint16_t dstseg, uint16_t
 void DriveManager::writeDisk (DriveTarget driveTarget, uint16_t dstseg, uint16_t dstoff, uint16_t cyl, uint16_t sect, uint16_t head, uint16_t sectcount) 
 {
 	Drive& drive = drives[driveTarget];
-	uint32_t memdest, lba, fileoffset, cursect, sectoffset;
+	uint32_t memdest, lba, fileoffset, cursect;
 	if (!sect || !drive.disk) return;
 	lba = ((uint32_t)cyl * (uint32_t)drive.heads + (uint32_t)head) * (uint32_t)drive.sects + (uint32_t)sect - 1;
 	fileoffset = lba * 512;
@@ -163,11 +181,10 @@ void DriveManager::writeDisk (DriveTarget driveTarget, uint16_t dstseg, uint16_t
 	memdest = ((uint32_t)dstseg << 4) + (uint32_t)dstoff;
 	for (cursect = 0; cursect < sectcount; cursect++) 
 	{
-		for (sectoffset = 0; sectoffset < 512; sectoffset++) 
-		{
-			sectorbuffer[sectoffset] = vm.memory.readByte(memdest++);
-		}
-		drive.disk->write(sectorbuffer, 512);
+		const uint8_t* sector = vm.memory.getReadPointer(memdest, 512, sectorbuffer);
+		drive.disk->write(sector, 512);
+		cache.update(driveTarget, lba + cursect, sector);
+		memdest += 512;
 	}
 
 	vm.cpu.regs.byteregs[regal] = (uint8_t)sectcount;
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "Types.h"
+#include "SectorCache.h"
 
 namespace Faux86
 {
@@ -85,6 +86,10 @@ namespace Faux86
 			return drives[drive].disk != nullptr;
 		}
 
+		// Sectors kept in the read cache, zero to read straight from the disks
+		void setCacheSize(uint32_t sectors) { cache.setCapacity(sectors); }
+		const SectorCache::Stats& getCacheStats() const { return cache.getStats(); }
+
 		uint8_t hdcount = 0;
 
 	private:
@@ -94,10 +99,12 @@ namespace Faux86
 			uint16_t cyls;
 			uint16_t sects;
 			uint16_t heads;
+			uint32_t nextLBA = ~0u;		// Sector after the last read, to spot sequential reads
 		};
 
 		Drive drives[256];
 		uint8_t sectorbuffer[512];
+		SectorCache cache;
 		VM& vm;
 	};
 }
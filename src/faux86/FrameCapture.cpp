@@ -0,0 +1,158 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "VM.h"
+#include "FrameCapture.h"
+#include "MemUtils.h"
+
+using namespace Faux86;
+
+FrameCapture::FrameCapture(VM& inVM, DiskInterface* inOutput)
+	: output(inOutput)
+	, vm(inVM)
+{
+	buffer = new uint8_t[BufferSize];
+
+	uint32_t position = head;
+	put(position, "F86V", 4);
+	put16(position, Version);
+	put16(position, 0);
+	head = position;
+}
+
+FrameCapture::~FrameCapture()
+{
+	drain();
+	delete output;
+	delete[] buffer;
+}
+
+void FrameCapture::put(uint32_t& position, const void* data, uint32_t length)
+{
+	uint32_t offset = position & (BufferSize - 1);
+	uint32_t firstPart = BufferSize - offset;
+	if (firstPart > length)
+		firstPart = length;
+
+	MemUtils::memcpy(buffer + offset, data, firstPart);
+	MemUtils::memcpy(buffer, (const uint8_t*) data + firstPart, length - firstPart);
+	position += length;
+}
+
+void FrameCapture::put16(uint32_t& position, uint16_t value)
+{
+	uint8_t bytes[2] = { (uint8_t) value, (uint8_t)(value >> 8) };
+	put(position, bytes, 2);
+}
+
+void FrameCapture::put32(uint32_t& position, uint32_t value)
+{
+	uint8_t bytes[4] = { (uint8_t) value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+	put(position, bytes, 4);
+}
+
+void FrameCapture::captureFrame(const RenderSurface& surface, uint32_t width, uint32_t height, const uint8_t* changedLines, const Palette* palette)
+{
+	bool keyFrame = needKeyFrame || width != lastWidth || height != lastHeight;
+	bool paletteChanged = keyFrame || palette != lastPalette || palette->revision != lastPaletteRevision;
+
+	uint32_t rowCount = 0;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		if (keyFrame || changedLines[y])
+			rowCount++;
+	}
+
+	if (rowCount == 0 && !paletteChanged)
+		return;
+
+	uint32_t recordSize = 11 + rowCount * (2 + width);
+	if (paletteChanged)
+		recordSize += 1 + 256 * 3;
+
+	uint32_t position = head;
+	MemUtils::memoryBarrier();
+
+	if (recordSize > BufferSize - (position - tail))
+	{
+		// The writer has fallen behind; skip this frame and resend everything with the next
+		droppedFrames++;
+		needKeyFrame = true;
+		return;
+	}
+
+	if (paletteChanged)
+	{
+		uint8_t colours[256 * 3];
+		for (int n = 0; n < 256; n++)
+		{
+			colours[n * 3] = palette->colours[n].r;
+			colours[n * 3 + 1] = palette->colours[n].g;
+			colours[n * 3 + 2] = palette->colours[n].b;
+		}
+		put8(position, 'P');
+		put(position, colours, sizeof(colours));
+	}
+
+	put8(position, 'F');
+	put32(position, (uint32_t) vm.timing.getMS());
+	put16(position, (uint16_t) width);
+	put16(position, (uint16_t) height);
+	put16(position, (uint16_t) rowCount);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		if (keyFrame || changedLines[y])
+		{
+			put16(position, (uint16_t) y);
+			put(position, surface.pixels + y * surface.pitch, width);
+		}
+	}
+
+	MemUtils::memoryBarrier();
+	head = position;
+
+	lastWidth = width;
+	lastHeight = height;
+	lastPalette = palette;
+	lastPaletteRevision = palette->revision;
+	needKeyFrame = false;
+}
+
+void FrameCapture::drain()
+{
+	uint32_t position = tail;
+	uint32_t end = head;
+	MemUtils::memoryBarrier();
+
+	while (position != end)
+	{
+		uint32_t offset = position & (BufferSize - 1);
+		uint32_t length = end - position;
+		if (length > BufferSize - offset)
+			length = BufferSize - offset;
+
+		output->write(buffer + offset, length);
+		position += length;
+	}
+
+	MemUtils::memoryBarrier();
+	tail = position;
+}
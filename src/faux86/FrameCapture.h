@@ -0,0 +1,79 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include "Types.h"
+
+namespace Faux86
+{
+	class VM;
+	class Palette;
+	class DiskInterface;
+	struct RenderSurface;
+
+	// Records the emulated display as palette indexed deltas. The renderer
+	// queues each frame's changed rows and a host thread calls drain() to
+	// write them out, so file I/O never stalls the emulation.
+	//
+	// Stream layout, all values little endian:
+	//   header:  "F86V" u16 version u16 reserved
+	//   palette: 'P' then 256 RGB triples, whenever the colours change
+	//   frame:   'F' u32 time (ms) u16 width u16 height u16 rowCount
+	//            then rowCount times: u16 y, width palette indices
+	// The first frame, and any after a resolution change or a dropped frame,
+	// carries every row so a reader never needs data it has not seen.
+	class FrameCapture
+	{
+	public:
+		static constexpr uint16_t Version = 1;
+
+		// Takes ownership of the output, which is closed after the final drain
+		FrameCapture(VM& inVM, DiskInterface* inOutput);
+		~FrameCapture();
+
+		void captureFrame(const RenderSurface& surface, uint32_t width, uint32_t height, const uint8_t* changedLines, const Palette* palette);
+
+		// Writes out everything queued so far. Safe to call from another thread
+		void drain();
+
+		uint32_t getDroppedFrames() const { return droppedFrames; }
+
+	private:
+		void put(uint32_t& position, const void* data, uint32_t length);
+		void put8(uint32_t& position, uint8_t value) { put(position, &value, 1); }
+		void put16(uint32_t& position, uint16_t value);
+		void put32(uint32_t& position, uint32_t value);
+
+		static constexpr uint32_t BufferSize = 4 * 1024 * 1024;	// Power of two
+		uint8_t* buffer = nullptr;
+		volatile uint32_t head = 0;		// Only written by captureFrame
+		volatile uint32_t tail = 0;		// Only written by drain
+
+		uint32_t lastWidth = 0, lastHeight = 0;
+		const Palette* lastPalette = nullptr;
+		uint32_t lastPaletteRevision = 0;
+		bool needKeyFrame = true;
+		uint32_t droppedFrames = 0;
+
+		DiskInterface* output;
+		VM& vm;
+	};
+}
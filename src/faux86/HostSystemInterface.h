@@ -21,35 +21,34 @@
 #pragma once
 
 #include "Types.h"
+#include "Log.h"
 
 namespace Faux86
 {
-	enum LogChannel
-	{
-		LogVerbose,
-		LogFatal,
-		Log,
-		LogRaw,
-		LogDebugger
-	};
-
-	// Must be implemented by host system
-	void log(LogChannel channel, const char* message, ...);
-
 	class DiskInterface;
 	class VM;
 	class Palette;
 	struct RenderSurface;
+	class SurfaceSwapChain;
 
 	class FrameBufferInterface
 	{
 	public:
 		virtual void init(uint32_t desiredWidth, uint32_t desiredHeight) = 0;
 		virtual void resize(uint32_t desiredWidth, uint32_t desiredHeight) {}
+		// Surfaces may be indexed, in which case setPalette supplies the colours,
+		// or RGBA8888, in which case the renderer applies the palette itself
 		virtual RenderSurface* getSurface() = 0;
 
 		virtual void setPalette(Palette* palette) = 0;
 
+		// Hosts that present on their own schedule return a swap chain. The renderer
+		// then draws into its back buffer and publishes finished frames, and the host
+		// calls present() to show the newest one, applying getFrontPalette() when the
+		// chain is indexed. Otherwise the renderer draws into getSurface() and calls
+		// present() itself after each frame
+		virtual SurfaceSwapChain* getSwapChain() { return nullptr; }
+
 		virtual void present() {}
 	};
 
@@ -74,5 +73,6 @@ namespace Faux86
 		virtual TimerInterface& getTimer() = 0;
 		virtual AudioInterface& getAudio() = 0;
 		virtual DiskInterface* openFile(const char* filename) { return nullptr; }
+		virtual DiskInterface* createFile(const char* filename) { return nullptr; }
 	};
 }
@@ -0,0 +1,108 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "Log.h"
+#include "MemUtils.h"
+
+using namespace Faux86;
+
+namespace Faux86
+{
+	namespace Logging
+	{
+		uint32_t enabledChannels = ~((1u << LogVerbose) | (1u << LogRaw));
+
+		struct DeferredEntry
+		{
+			LogChannel channel;
+			const char* message;
+			uint32_t args[MaxDeferredArgs];
+			volatile uint32_t sequence;		// Ring position plus one once the entry is complete
+		};
+
+		// Any thread may log, so producers reserve a slot by advancing the head
+		// with a compare and exchange, then mark the entry complete. The single
+		// consumer (flush) stops at the first entry that is still being written
+		constexpr uint32_t RingSize = 256;
+		static DeferredEntry ring[RingSize];
+		static volatile uint32_t ringHead = 0;
+		static volatile uint32_t ringTail = 0;
+		static volatile uint32_t droppedEntries = 0;
+		static uint32_t reportedDrops = 0;
+	}
+}
+
+void Logging::defer(LogChannel channel, const char* message, const uint32_t* args)
+{
+	uint32_t head;
+
+	do
+	{
+		head = ringHead;
+
+		if (head - ringTail >= RingSize)
+		{
+			uint32_t dropped;
+			do
+			{
+				dropped = droppedEntries;
+			} while (!MemUtils::atomicCompareExchange(&droppedEntries, dropped, dropped + 1));
+			return;
+		}
+	} while (!MemUtils::atomicCompareExchange(&ringHead, head, head + 1));
+
+	DeferredEntry& entry = ring[head & (RingSize - 1)];
+	entry.channel = channel;
+	entry.message = message;
+	for (int n = 0; n < MaxDeferredArgs; n++)
+	{
+		entry.args[n] = args[n];
+	}
+
+	MemUtils::memoryBarrier();
+	entry.sequence = head + 1;
+}
+
+void Logging::flush()
+{
+	uint32_t tail = ringTail;
+
+	for (;;)
+	{
+		const DeferredEntry& entry = ring[tail & (RingSize - 1)];
+		if (entry.sequence != tail + 1)
+			break;
+
+		MemUtils::memoryBarrier();
+		hostLog(entry.channel, entry.message, entry.args[0], entry.args[1], entry.args[2], entry.args[3], entry.args[4], entry.args[5]);
+		tail++;
+
+		// Hand the slot back only once it has been read
+		MemUtils::memoryBarrier();
+		ringTail = tail;
+	}
+
+	uint32_t dropped = droppedEntries;
+	if (dropped != reportedDrops)
+	{
+		hostLog(Log, "%u log entries dropped", dropped - reportedDrops);
+		reportedDrops = dropped;
+	}
+}
@@ -20,11 +20,119 @@
 */
 #pragma once
 
+#include "Types.h"
+#include "Config.h"
+
 namespace Faux86
 {
-	class ILogInterface
+	enum LogChannel
 	{
-	public:
-		virtual void log(const char* message);
+		LogVerbose,
+		LogFatal,
+		Log,
+		LogRaw,
+		LogDebugger
 	};
-}
\ No newline at end of file
+
+	enum LogLevel
+	{
+		LogLevelVerbose = 0,
+		LogLevelInfo = 1,
+		LogLevelFatal = 2
+	};
+
+	// Must be implemented by host system
+	void hostLog(LogChannel channel, const char* message, ...);
+
+	namespace Logging
+	{
+		constexpr int MaxDeferredArgs = 6;
+
+		// One bit per LogChannel, checked before any formatting takes place
+		extern uint32_t enabledChannels;
+
+		constexpr int levelOf(LogChannel channel)
+		{
+			return channel == LogFatal ? LogLevelFatal
+				: (channel == LogVerbose || channel == LogRaw) ? LogLevelVerbose
+				: LogLevelInfo;
+		}
+
+		// Verbose channels are queued and written out later by flush()
+		constexpr bool isDeferred(LogChannel channel)
+		{
+			return levelOf(channel) == LogLevelVerbose;
+		}
+
+		inline bool isEnabled(LogChannel channel)
+		{
+			return levelOf(channel) >= LOG_MIN_LEVEL && (enabledChannels & (1u << channel)) != 0;
+		}
+
+		inline void setChannelEnabled(LogChannel channel, bool enabled)
+		{
+			if (enabled)
+				enabledChannels |= (1u << channel);
+			else
+				enabledChannels &= ~(1u << channel);
+		}
+
+		void defer(LogChannel channel, const char* message, const uint32_t* args);
+		void flush();
+
+		// Only integer arguments can be queued, anything else is written straight to the host
+		template <typename T> struct IsDeferrable { static constexpr bool value = false; };
+		template <> struct IsDeferrable<bool> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<char> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<signed char> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<unsigned char> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<short> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<unsigned short> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<int> { static constexpr bool value = true; };
+		template <> struct IsDeferrable<unsigned int> { static constexpr bool value = true; };
+
+		template <typename... Args> struct AllDeferrable { static constexpr bool value = true; };
+		template <typename T, typename... Rest> struct AllDeferrable<T, Rest...>
+		{
+			static constexpr bool value = IsDeferrable<T>::value && AllDeferrable<Rest...>::value;
+		};
+
+		template <bool Deferrable> struct Dispatch
+		{
+			template <typename... Args>
+			static void write(LogChannel channel, const char* message, Args... args)
+			{
+				hostLog(channel, message, args...);
+			}
+		};
+
+		template <> struct Dispatch<true>
+		{
+			template <typename... Args>
+			static void write(LogChannel channel, const char* message, Args... args)
+			{
+				if (isDeferred(channel))
+				{
+					const uint32_t values[MaxDeferredArgs] = { static_cast<uint32_t>(args)... };
+					defer(channel, message, values);
+				}
+				else
+				{
+					hostLog(channel, message, args...);
+				}
+			}
+		};
+	}
+
+	// Channels below LOG_MIN_LEVEL compile away entirely; the rest cost a mask
+	// test when disabled, and the verbose ones never format on the caller's thread.
+	// Arguments are still evaluated, so guard costly ones with Logging::isEnabled
+	template <typename... Args>
+	inline void log(LogChannel channel, const char* message, Args... args)
+	{
+		if (Logging::isEnabled(channel))
+		{
+			Logging::Dispatch<(sizeof...(Args) <= Logging::MaxDeferredArgs) && Logging::AllDeferrable<Args...>::value>::write(channel, message, args...);
+		}
+	}
+}
@@ -18,129 +18,282 @@
   along with this program; if not, write to the Free Software
   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
+#include "Config.h"
 #include "MemUtils.h"
 
+#if !defined(__circle__)
+#include <string.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MEMUTILS_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MEMUTILS_NEON
+#endif
+
+#ifdef BENCHMARK_MEMUTILS
+#include "Timing.h"
+#endif
+
 using namespace Faux86;
 
+#if !defined(__circle__)
+
+/*
+	Hosted builds have a C library with memory routines tuned for the
+	machine they run on, so there is nothing to gain from our own.
+*/
 void* MemUtils::memmove(void *dst, const void *src, size_t len)
 {
-    size_t i;
-
-    /*
-        * If the buffers don't overlap, it doesn't matter what direction
-        * we copy in. If they do, it does, so just assume they always do.
-        * We don't concern ourselves with the possibility that the region
-        * to copy might roll over across the top of memory, because it's
-        * not going to happen.
-        *
-        * If the destination is above the source, we have to copy
-        * back to front to avoid overwriting the data we want to
-        * copy.
-        *
-        *      dest:       dddddddd
-        *      src:    ssssssss   ^
-        *              |   ^  |___|
-        *              |___|
-        *
-        * If the destination is below the source, we have to copy
-        * front to back.
-        *
-        *      dest:   dddddddd
-        *      src:    ^   ssssssss
-        *              |___|  ^   |
-        *                     |___|
-        */
-
-    if ((uintptr_t)dst < (uintptr_t)src) {
-            /*
-                * As author/maintainer of libc, take advantage of the
-                * fact that we know memcpy copies forwards.
-                */
-            return memcpy(dst, src, len);
-    }
-
-    /*
-        * Copy by words in the common case. Look in memcpy.c for more
-        * information.
-        */
-
-    if ((uintptr_t)dst % sizeof(long) == 0 &&
-        (uintptr_t)src % sizeof(long) == 0 &&
-        len % sizeof(long) == 0) {
-
-            long *d = (long*)dst;
-            const long *s = (const long*) src;
-
-            /*
-                * The reason we copy index i-1 and test i>0 is that
-                * i is unsigned -- so testing i>=0 doesn't work.
-                */
-
-            for (i=len/sizeof(long); i>0; i--) {
-                    d[i-1] = s[i-1];
-            }
-    }
-    else {
-            char *d = (char*)dst;
-            const char *s = (const char*)src;
-
-            for (i=len; i>0; i--) {
-                    d[i-1] = s[i-1];
-            }
-    }
-
-    return dst;
+	return ::memmove(dst, src, len);
 }
 
+void* MemUtils::memcpy(void *dst, const void *src, size_t len)
+{
+	return ::memcpy(dst, src, len);
+}
+
+void* MemUtils::memset(void *ptr, int ch, size_t len)
+{
+	return ::memset(ptr, ch, len);
+}
+
+#else
+
+/*
+	Bare metal versions. Each copies single bytes until the destination is
+	aligned, moves the body 64 bytes at a time with the widest stores the
+	target has (16 byte vectors, or 32 bit words without SIMD) and then
+	finishes the tail a byte at a time. Within a block every load is issued
+	before any store, which keeps forward copies safe for memmove when the
+	destination is below the source.
+*/
+
+static constexpr size_t BlockSize = 64;
+static constexpr size_t Alignment = 16;
+
+static inline void copyBlockForward(uint8_t* d, const uint8_t* s)
+{
+#if defined(MEMUTILS_SSE2)
+	__m128i a = _mm_loadu_si128((const __m128i*) s);
+	__m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+	__m128i c = _mm_loadu_si128((const __m128i*) (s + 32));
+	__m128i e = _mm_loadu_si128((const __m128i*) (s + 48));
+	_mm_store_si128((__m128i*) d, a);
+	_mm_store_si128((__m128i*) (d + 16), b);
+	_mm_store_si128((__m128i*) (d + 32), c);
+	_mm_store_si128((__m128i*) (d + 48), e);
+#elif defined(MEMUTILS_NEON)
+	uint8x16_t a = vld1q_u8(s);
+	uint8x16_t b = vld1q_u8(s + 16);
+	uint8x16_t c = vld1q_u8(s + 32);
+	uint8x16_t e = vld1q_u8(s + 48);
+	vst1q_u8(d, a);
+	vst1q_u8(d + 16, b);
+	vst1q_u8(d + 32, c);
+	vst1q_u8(d + 48, e);
+#else
+	uint32_t words[BlockSize / 4];
+	if (((uintptr_t)s & 3) == 0)
+	{
+		for (size_t n = 0; n < BlockSize / 4; n++)
+			words[n] = ((const uint32_t*) s)[n];
+	}
+	else
+	{
+		for (size_t n = 0; n < BlockSize / 4; n++)
+			words[n] = s[n * 4] | (s[n * 4 + 1] << 8) | (s[n * 4 + 2] << 16) | ((uint32_t)s[n * 4 + 3] << 24);
+	}
+	for (size_t n = 0; n < BlockSize / 4; n++)
+		((uint32_t*) d)[n] = words[n];
+#endif
+}
 
 void* MemUtils::memcpy(void *dst, const void *src, size_t len)
 {
-    size_t i;
-
-    /*
-        * memcpy does not support overlapping buffers, so always do it
-        * forwards. (Don't change this without adjusting memmove.)
-        *
-        * For speedy copying, optimize the common case where both pointers
-        * and the length are word-aligned, and copy word-at-a-time instead
-        * of byte-at-a-time. Otherwise, copy by bytes.
-        *
-        * The alignment logic below should be portable. We rely on
-        * the compiler to be reasonably intelligent about optimizing
-        * the divides and modulos out. Fortunately, it is.
-        */
-
-    if ((uintptr_t)dst % sizeof(long) == 0 &&
-        (uintptr_t)src % sizeof(long) == 0 &&
-        len % sizeof(long) == 0) {
-
-            long *d = (long*)dst;
-            const long *s = (const long*)src;
-
-            for (i=0; i<len/sizeof(long); i++) {
-                    d[i] = s[i];
-            }
-    }
-    else {
-            char *d = (char*)dst;
-            const char *s = (const char*)src;
-
-            for (i=0; i<len; i++) {
-                    d[i] = s[i];
-            }
-    }
-
-    return dst;
+	uint8_t* d = (uint8_t*) dst;
+	const uint8_t* s = (const uint8_t*) src;
+
+	if (len >= BlockSize + Alignment)
+	{
+		while ((uintptr_t)d & (Alignment - 1))
+		{
+			*d++ = *s++;
+			len--;
+		}
+
+		for (; len >= BlockSize; len -= BlockSize)
+		{
+			copyBlockForward(d, s);
+			d += BlockSize;
+			s += BlockSize;
+		}
+	}
+
+	while (len--)
+	{
+		*d++ = *s++;
+	}
+
+	return dst;
+}
+
+void* MemUtils::memmove(void *dst, const void *src, size_t len)
+{
+	uint8_t* d = (uint8_t*) dst;
+	const uint8_t* s = (const uint8_t*) src;
+
+	// Copying forwards is safe unless the destination starts inside the source
+	if (d <= s || d >= s + len)
+	{
+		return memcpy(dst, src, len);
+	}
+
+	d += len;
+	s += len;
+
+	if (len >= BlockSize + Alignment)
+	{
+		while ((uintptr_t)d & (Alignment - 1))
+		{
+			*--d = *--s;
+			len--;
+		}
+
+		// Blocks are taken from the top down, so the source bytes a block
+		// overwrites have always been read already
+		for (; len >= BlockSize; len -= BlockSize)
+		{
+			d -= BlockSize;
+			s -= BlockSize;
+			copyBlockForward(d, s);
+		}
+	}
+
+	while (len--)
+	{
+		*--d = *--s;
+	}
+
+	return dst;
 }
 
 void* MemUtils::memset(void *ptr, int ch, size_t len)
 {
-    char *p = (char*)ptr;
-    size_t i;
-        
-    for (i=0; i<len; i++) {
-        p[i] = ch;
-    }
-
-    return ptr;
-}
\ No newline at end of file
+	uint8_t* p = (uint8_t*) ptr;
+	uint8_t value = (uint8_t) ch;
+
+	if (len >= BlockSize + Alignment)
+	{
+		while ((uintptr_t)p & (Alignment - 1))
+		{
+			*p++ = value;
+			len--;
+		}
+
+#if defined(MEMUTILS_SSE2)
+		__m128i fill = _mm_set1_epi8((char) value);
+		for (; len >= BlockSize; len -= BlockSize, p += BlockSize)
+		{
+			_mm_store_si128((__m128i*) p, fill);
+			_mm_store_si128((__m128i*) (p + 16), fill);
+			_mm_store_si128((__m128i*) (p + 32), fill);
+			_mm_store_si128((__m128i*) (p + 48), fill);
+		}
+#elif defined(MEMUTILS_NEON)
+		uint8x16_t fill = vdupq_n_u8(value);
+		for (; len >= BlockSize; len -= BlockSize, p += BlockSize)
+		{
+			vst1q_u8(p, fill);
+			vst1q_u8(p + 16, fill);
+			vst1q_u8(p + 32, fill);
+			vst1q_u8(p + 48, fill);
+		}
+#else
+		uint32_t fill = value * 0x01010101u;
+		for (; len >= BlockSize; len -= BlockSize, p += BlockSize)
+		{
+			for (size_t n = 0; n < BlockSize / 4; n++)
+				((uint32_t*) p)[n] = fill;
+		}
+#endif
+	}
+
+	while (len--)
+	{
+		*p++ = value;
+	}
+
+	return ptr;
+}
+
+#endif
+
+#ifdef BENCHMARK_MEMUTILS
+/*
+	Times MemUtils against plain byte loops, which is what the original
+	versions fell back to for anything that was not long aligned.
+*/
+static void byteCopy(uint8_t* d, const uint8_t* s, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		d[i] = s[i];
+}
+
+static void byteSet(uint8_t* p, uint8_t value, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		p[i] = value;
+}
+
+void MemUtils::benchmark(TimingScheduler& timing)
+{
+	static constexpr size_t BufferSize = 0x10000;
+	static constexpr int Iterations = 200;
+	static const size_t sizes[] = { 16, 320, 4000, 0x10000 - 16 };
+
+	uint8_t* source = new uint8_t[BufferSize + 16];
+	uint8_t* dest = new uint8_t[BufferSize + 16];
+	byteSet(source, 0x5A, BufferSize + 16);
+
+	for (size_t size : sizes)
+	{
+		for (size_t misalign = 0; misalign < 2; misalign++)
+		{
+			size_t repeats = Iterations * (BufferSize / size);
+			uint64_t start, bytes, fast, bytewise, fastSet, bytewiseSet;
+
+			start = timing.getTicks();
+			for (size_t n = 0; n < repeats; n++)
+				MemUtils::memcpy(dest + misalign, source, size);
+			fast = timing.getTicks() - start;
+
+			start = timing.getTicks();
+			for (size_t n = 0; n < repeats; n++)
+				byteCopy(dest + misalign, source, size);
+			bytewise = timing.getTicks() - start;
+
+			start = timing.getTicks();
+			for (size_t n = 0; n < repeats; n++)
+				MemUtils::memset(dest + misalign, (int) n, size);
+			fastSet = timing.getTicks() - start;
+
+			start = timing.getTicks();
+			for (size_t n = 0; n < repeats; n++)
+				byteSet(dest + misalign, (uint8_t) n, size);
+			bytewiseSet = timing.getTicks() - start;
+
+			bytes = (uint64_t) repeats * size;
+			log(Log, "MemUtils %6u bytes %s: memcpy %u MB/s (byte loop %u MB/s), memset %u MB/s (byte loop %u MB/s)",
+				(unsigned) size, misalign ? "unaligned" : "aligned  ",
+				(unsigned) (bytes * timing.getHostFreq() / (fast ? fast : 1) >> 20),
+				(unsigned) (bytes * timing.getHostFreq() / (bytewise ? bytewise : 1) >> 20),
+				(unsigned) (bytes * timing.getHostFreq() / (fastSet ? fastSet : 1) >> 20),
+				(unsigned) (bytes * timing.getHostFreq() / (bytewiseSet ? bytewiseSet : 1) >> 20));
+		}
+	}
+
+	delete[] source;
+	delete[] dest;
+}
+#endif
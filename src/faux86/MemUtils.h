@@ -22,12 +22,52 @@
 
 #include "Types.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace Faux86
 {
+	class TimingScheduler;
+
 	namespace MemUtils
 	{
 		void* memmove(void *dst, const void *src, size_t len);
 		void* memcpy(void *dst, const void *src, size_t len);
 		void* memset(void *ptr, int ch, size_t len);
+
+		// Orders memory accesses around the indices of single producer / single consumer queues
+		inline void memoryBarrier()
+		{
+#if defined(_MSC_VER)
+			_ReadWriteBarrier();
+#else
+			__sync_synchronize();
+#endif
+		}
+
+		// Stores value and returns what was there before, as one atomic step with a full barrier
+		inline uint32_t atomicExchange(volatile uint32_t* target, uint32_t value)
+		{
+#if defined(_MSC_VER)
+			return (uint32_t) _InterlockedExchange((volatile long*) target, (long) value);
+#else
+			return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#endif
+		}
+
+		// Stores value only if target still holds expected, as one atomic step with a full
+		// barrier. Returns whether the store happened
+		inline bool atomicCompareExchange(volatile uint32_t* target, uint32_t expected, uint32_t value)
+		{
+#if defined(_MSC_VER)
+			return (uint32_t) _InterlockedCompareExchange((volatile long*) target, (long) value, (long) expected) == expected;
+#else
+			return __atomic_compare_exchange_n(target, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+		}
+
+		// Logs throughput against plain byte loops. Only built with BENCHMARK_MEMUTILS
+		void benchmark(TimingScheduler& timing);
 	}
 }
\ No newline at end of file
@@ -21,32 +21,235 @@
 
 #include "VM.h"
 #include "PCSpeaker.h"
+#include "MemUtils.h"
 
 using namespace Faux86;
 
-int16_t PCSpeaker::generateSample() 
+// Band-limited step residuals (Blackman windowed sinc step minus an ideal
+// step) in Q15, one row per sub-sample phase. The step is centred on tap 7
+// so output is delayed by half the kernel length.
+static const int32_t blepTable[32][16] =
+{
+	{ -32767, -32807, -32642, -32991, -32620, -32341, -34980, -16384, 2212, -427, -148, 223, -126, 39, -1, 0 },
+	{ -32766, -32807, -32649, -32966, -32679, -32239, -35114, -17244, 2051, -317, -209, 248, -132, 40, -1, 0 },
+	{ -32766, -32806, -32657, -32941, -32736, -32145, -35221, -18102, 1862, -198, -271, 273, -138, 40, -1, 0 },
+	{ -32766, -32805, -32664, -32916, -32791, -32060, -35304, -18955, 1644, -73, -334, 296, -143, 39, 0, 0 },
+	{ -32766, -32804, -32672, -32891, -32843, -31983, -35361, -19803, 1396, 59, -398, 319, -147, 39, 0, 0 },
+	{ -32766, -32802, -32680, -32866, -32893, -31916, -35396, -20642, 1118, 197, -462, 340, -150, 38, 1, 0 },
+	{ -32766, -32801, -32689, -32842, -32939, -31858, -35408, -21472, 810, 340, -525, 360, -152, 36, 2, 0 },
+	{ -32766, -32799, -32697, -32819, -32982, -31809, -35400, -22289, 472, 487, -587, 379, -154, 34, 2, 0 },
+	{ -32766, -32797, -32705, -32797, -33021, -31769, -35373, -23093, 102, 638, -648, 395, -154, 32, 3, 0 },
+	{ -32766, -32795, -32714, -32775, -33057, -31738, -35327, -23881, -298, 792, -707, 409, -153, 29, 4, 0 },
+	{ -32766, -32793, -32722, -32755, -33088, -31716, -35264, -24651, -729, 947, -763, 421, -150, 26, 5, 0 },
+	{ -32767, -32792, -32730, -32736, -33117, -31702, -35186, -25403, -1191, 1102, -817, 431, -147, 22, 7, 0 },
+	{ -32767, -32790, -32738, -32718, -33141, -31697, -35095, -26133, -1683, 1258, -866, 437, -142, 18, 8, 0 },
+	{ -32767, -32788, -32745, -32701, -33162, -31699, -34990, -26842, -2205, 1411, -912, 441, -135, 14, 9, 0 },
+	{ -32767, -32786, -32752, -32686, -33179, -31709, -34875, -27528, -2757, 1561, -953, 442, -127, 9, 11, -1 },
+	{ -32767, -32784, -32759, -32673, -33192, -31726, -34749, -28188, -3337, 1707, -988, 439, -118, 3, 13, -1 },
+	{ -32767, -32782, -32765, -32661, -33201, -31750, -34616, -28823, -3945, 1848, -1018, 433, -107, -3, 14, -1 },
+	{ -32767, -32781, -32771, -32650, -33207, -31780, -34475, -29431, -4580, 1981, -1042, 424, -95, -9, 16, -1 },
+	{ -32767, -32779, -32777, -32641, -33210, -31815, -34329, -30011, -5240, 2107, -1059, 411, -82, -16, 18, -1 },
+	{ -32768, -32777, -32782, -32633, -33209, -31856, -34179, -30563, -5926, 2222, -1069, 394, -67, -23, 20, -1 },
+	{ -32768, -32776, -32786, -32626, -33205, -31902, -34026, -31085, -6635, 2327, -1071, 373, -50, -30, 22, -1 },
+	{ -32768, -32775, -32790, -32621, -33199, -31951, -33870, -31577, -7365, 2418, -1066, 349, -32, -38, 24, -1 },
+	{ -32768, -32773, -32794, -32618, -33189, -32005, -33715, -32039, -8117, 2496, -1052, 320, -13, -46, 25, -2 },
+	{ -32768, -32772, -32797, -32615, -33177, -32061, -33560, -32470, -8887, 2559, -1030, 289, 7, -54, 27, -2 },
+	{ -32768, -32771, -32800, -32614, -33163, -32120, -33406, -32870, -9675, 2605, -999, 253, 29, -63, 29, -2 },
+	{ -32768, -32770, -32802, -32614, -33147, -32181, -33255, -33240, -10479, 2632, -959, 214, 51, -71, 31, -2 },
+	{ -32768, -32770, -32804, -32616, -33128, -32243, -33108, -33578, -11296, 2640, -910, 171, 74, -79, 33, -2 },
+	{ -32768, -32769, -32806, -32618, -33108, -32306, -32965, -33886, -12126, 2628, -852, 125, 98, -88, 34, -2 },
+	{ -32768, -32768, -32807, -32621, -33087, -32370, -32827, -34164, -12965, 2593, -785, 75, 123, -96, 36, -2 },
+	{ -32768, -32768, -32807, -32625, -33064, -32434, -32695, -34412, -13813, 2536, -708, 23, 148, -104, 37, -2 },
+	{ -32768, -32767, -32808, -32630, -33041, -32497, -32570, -34630, -14666, 2453, -623, -32, 173, -111, 38, -2 },
+	{ -32768, -32767, -32808, -32636, -33016, -32559, -32451, -34819, -15524, 2346, -529, -89, 198, -119, 39, -2 },
+};
+
+static constexpr uint32_t PITFrequency = 1193182;
+
+PCSpeaker::PCSpeaker(VM& inVM)
+	: vm(inVM)
+{
+	MemUtils::memset(steps, 0, sizeof(steps));
+}
+
+void PCSpeaker::init()
 {
-	int16_t speakervalue;
+	lastRenderTick = vm.timing.getCurrentTick();
+}
 
-	speakerfullstep = (uint64_t) ( (float) vm.timing.gensamplerate / (float) vm.pit.chanfreq[2]);
-	if (speakerfullstep < 2)
+void PCSpeaker::writePort(uint8_t value)
+{
+	queueEvent(EventType::Port, value);
+}
+
+void PCSpeaker::reloadCounter(uint32_t count)
+{
+	queueEvent(EventType::Reload, count);
+}
+
+void PCSpeaker::queueEvent(EventType type, uint32_t value)
+{
+	if (eventCount == MaxEvents)
 	{
-		speakerfullstep = 2;
+		// Out of space: retire the oldest event at the start of the next block
+		applyEvent(events[eventHead], 0);
+		eventHead = (eventHead + 1) % MaxEvents;
+		eventCount--;
 	}
-	speakerhalfstep = speakerfullstep >> 1;
-	if (speakercurstep < speakerhalfstep) 
+
+	Event& event = events[(eventHead + eventCount) % MaxEvents];
+	event.time = vm.timing.getCurrentTick();
+	event.value = value;
+	event.type = type;
+	eventCount++;
+}
+
+void PCSpeaker::applyEvent(const Event& event, uint64_t position)
+{
+	switch (event.type)
 	{
-		speakervalue = 32;
+	case EventType::Port:
+		{
+			uint8_t newGate = event.value & 1;
+			data = (event.value >> 1) & 1;
+
+			if (newGate != gate)
+			{
+				// Raising the gate restarts the counter with its output high,
+				// while a low gate holds the output high
+				gate = newGate;
+				pitOutput = 1;
+				nextToggle = (gate && halfPeriod && !ultrasonic) ? position + halfPeriod : Never;
+			}
+		}
+		break;
+	case EventType::Reload:
+		setCounter(event.value, position);
+		break;
 	}
-	else 
+
+	updateLevel(position);
+}
+
+void PCSpeaker::setCounter(uint32_t count, uint64_t position)
+{
+	halfPeriod = ((uint64_t)count * vm.timing.gensamplerate << 16) / (2 * PITFrequency);
+
+	// Above the Nyquist limit the speaker can only be heard as its average level
+	ultrasonic = halfPeriod < (1 << 16);
+
+	if (!gate || ultrasonic)
+	{
+		nextToggle = Never;
+	}
+	else if (nextToggle == Never)
 	{
-		speakervalue = -32;
+		nextToggle = position + halfPeriod;
 	}
-	speakercurstep = (speakercurstep + 1) % speakerfullstep;
-	return (speakervalue);
 }
 
-PCSpeaker::PCSpeaker(VM& inVM)
-	: vm(inVM)
+void PCSpeaker::updateLevel(uint64_t position)
 {
+	// With the data bit clear the cone rests at zero, otherwise it follows
+	// the counter output (or sits at its average when ultrasonic)
+	int32_t newLevel = 0;
+
+	if (data && !(gate && ultrasonic))
+	{
+		newLevel = pitOutput ? Amplitude : -Amplitude;
+	}
+
+	if (newLevel != level)
+	{
+		addStep(position, newLevel - level);
+		level = newLevel;
+	}
+}
+
+void PCSpeaker::addStep(uint64_t position, int32_t delta)
+{
+	const int32_t* residual = blepTable[((position & 0xffff) * BlepPhases) >> 16];
+
+	for (int n = 0; n < BlepTaps; n++)
+	{
+		steps[(stepPos + n) & (StepBufferSize - 1)] += delta * residual[n];
+	}
+
+	stepsPending = BlepTaps;
+}
+
+void PCSpeaker::render(int16_t* buffer, int numSamples)
+{
+	uint64_t prevTick = lastRenderTick;
+	uint64_t elapsed = vm.timing.getCurrentTick() - prevTick;
+	uint64_t blockLength = (uint64_t)numSamples << 16;
+
+	lastRenderTick += elapsed;
+
+	if (!eventCount && nextToggle == Never && !stepsPending)
+	{
+		for (int n = 0; n < numSamples; n++)
+		{
+			buffer[n] = (int16_t)level;
+		}
+		return;
+	}
+
+	for (int n = 0; n < numSamples; n++)
+	{
+		uint64_t sampleEnd = (uint64_t)(n + 1) << 16;
+
+		for (;;)
+		{
+			// Events are spread over the block in proportion to when they
+			// happened between the last render and now
+			uint64_t eventPos = Never;
+			if (eventCount)
+			{
+				uint64_t eventTime = events[eventHead].time;
+				if (eventTime <= prevTick || !elapsed)
+					eventPos = 0;
+				else
+					eventPos = (eventTime - prevTick) * blockLength / elapsed;
+			}
+
+			if (nextToggle < sampleEnd && nextToggle <= eventPos)
+			{
+				pitOutput ^= 1;
+				updateLevel(nextToggle);
+				nextToggle += halfPeriod;
+			}
+			else if (eventPos < sampleEnd)
+			{
+				applyEvent(events[eventHead], eventPos);
+				eventHead = (eventHead + 1) % MaxEvents;
+				eventCount--;
+			}
+			else break;
+		}
+
+		int32_t residual = steps[stepPos];
+		steps[stepPos] = 0;
+		stepPos = (stepPos + 1) & (StepBufferSize - 1);
+		if (stepsPending)
+			stepsPending--;
+
+		buffer[n] = (int16_t)(level + (residual >> 15));
+	}
+
+	if (nextToggle != Never)
+	{
+		nextToggle -= blockLength;
+	}
+}
+
+int16_t PCSpeaker::generateSample() 
+{
+	if (blockPos == BlockSize)
+	{
+		render(block, BlockSize);
+		blockPos = 0;
+	}
+
+	return block[blockPos++];
 }
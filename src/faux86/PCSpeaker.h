@@ -27,20 +27,80 @@ namespace Faux86
 {
 	class VM;
 
+	// PC speaker driven by PIT channel 2 and the gate/data bits of port 61h.
+	// Port writes and counter reloads are queued with timestamps and replayed
+	// when audio is generated, with each output transition synthesised as a
+	// band-limited step (BLEP) so that square waves and PWM samples don't alias.
 	class PCSpeaker : public SoundCardInterface
 	{
 	public:
 		PCSpeaker(VM& inVM);
 
+		void init() override;
+		// Returns the next output sample, synthesising a block at a time. Must be
+		// called once per output sample even when the output is discarded, so
+		// queued events stay in step with the time they were written
 		int16_t generateSample() override;
 
-		bool enabled = false;
+		void render(int16_t* buffer, int numSamples);
+
+		void writePort(uint8_t value);
+		void reloadCounter(uint32_t count);
 
 	private:
+		enum class EventType : uint8_t
+		{
+			Port,
+			Reload
+		};
+
+		struct Event
+		{
+			uint64_t time;
+			uint32_t value;
+			EventType type;
+		};
+
+		// Samples synthesised at a time. Events are placed within a block by
+		// their timestamps, so this only adds a block of latency
+		static constexpr int BlockSize = 64;
+		static constexpr int MaxEvents = 1024;
+		static constexpr int BlepTaps = 16;
+		static constexpr int BlepPhases = 32;
+		static constexpr int StepBufferSize = 32;
+		static constexpr int32_t Amplitude = 32;
+		static constexpr uint64_t Never = ~(uint64_t)0;
+
+		void queueEvent(EventType type, uint32_t value);
+		void applyEvent(const Event& event, uint64_t position);
+		void setCounter(uint32_t count, uint64_t position);
+		void updateLevel(uint64_t position);
+		void addStep(uint64_t position, int32_t delta);
+
 		VM& vm;
 
-		uint64_t speakerfullstep, speakerhalfstep, speakercurstep = 0;
-		int16_t speakerpos = 0;
+		Event events[MaxEvents];
+		int eventHead = 0;
+		int eventCount = 0;
+		uint64_t lastRenderTick = 0;
+
+		// Positions are in output samples with a 16 bit fraction,
+		// relative to the start of the block being rendered
+		uint64_t halfPeriod = 0;
+		uint64_t nextToggle = Never;
+		bool ultrasonic = false;
+
+		uint8_t gate = 0;
+		uint8_t data = 0;
+		uint8_t pitOutput = 1;
+		int32_t level = 0;
+
+		int32_t steps[StepBufferSize];
+		int stepPos = 0;
+		int stepsPending = 0;
+
+		int16_t block[BlockSize];
+		int blockPos = BlockSize;
 	};
 }
 
@@ -58,6 +58,8 @@ bool PIT::portWriteHandler(uint16_t portnum, uint8_t value)
 			if (accessmode[portnum] == Mode::Toggle) 
 				bytetoggle[portnum] = (~bytetoggle[portnum]) & 1;
 			chanfreq[portnum] = (float) ( (uint32_t) ( ( (float) 1193182.0 / (float) effectivedata[portnum]) * (float) 1000.0) ) / (float) 1000.0;
+			if (portnum == 2 && (accessmode[portnum] != Mode::Toggle || bytetoggle[portnum] == 0))
+				vm.pcSpeaker.reloadCounter(effectivedata[portnum]);
 			//printf("[DEBUG] PIT channel %u counter changed to %u (%f Hz)\n", portnum, chandata[portnum], chanfreq[portnum]);
 			break;
 		case 3: //mode/command
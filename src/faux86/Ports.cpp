@@ -57,14 +57,8 @@ void Ports::outByte (uint16_t portnum, uint8_t value)
 		}
 			break;
 		case 0x61:
-			if ((value & 3) == 3)
-			{
-				vm.pcSpeaker.enabled = true;
-			}
-			else
-			{
-				vm.pcSpeaker.enabled = false;
-			}
+			portram[portnum] = value;
+			vm.pcSpeaker.writePort(value);
 			return;
 	}
 
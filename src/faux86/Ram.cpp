@@ -22,6 +22,7 @@
 #include "Ram.h"
 #include "VM.h"
 #include "Debugger.h"
+#include "MemUtils.h"
 
 using namespace Faux86;
 
@@ -59,26 +60,8 @@ void Memory::writeByte(uint32_t addr32, uint8_t value)
 
 	if ((tempaddr32 >= 0xA0000) && (tempaddr32 <= 0xBFFFF)) 
 	{
-		vm.renderer.onMemoryWrite(addr32, value);
-		if ((vm.video.vidmode != 0x13) && (vm.video.vidmode != 0x12) && (vm.video.vidmode != 0xD) && (vm.video.vidmode != 0x10))
-		{
-			RAM[tempaddr32] = value;
-			vm.video.updatedscreen = 1;
-		}
-		else if (((vm.video.VGA_SC[4] & 6) == 0) && (vm.video.vidmode != 0xD) && (vm.video.vidmode != 0x10) && (vm.video.vidmode != 0x12))
-		{
-			RAM[tempaddr32] = value;
-			vm.video.updatedscreen = 1;
-		}
-		else if (addr32 < 0xB0000)
-		{
-			vm.video.writeVGA(tempaddr32 - 0xA0000, value);
-		}
-		else
-		{
-			RAM[tempaddr32] = value;
-		}
-
+		vm.renderer.onMemoryWrite(tempaddr32, value);
+		(vm.video.*vm.video.memoryWrite)(tempaddr32, value);
 		vm.video.updatedscreen = 1;
 	}
 	else 
@@ -98,34 +81,8 @@ void Memory::writeWord(uint32_t addr32, uint16_t value)
 	writeByte(addr32 + 1, (uint8_t)(value >> 8));
 }
 
-uint8_t Memory::readByte(uint32_t addr32) 
+inline void Memory::applyBootstrapHacks()
 {
-	//if (addr32 >= 0xC0000UL && addr32 < 0xC0000UL + 0x8000)
-	//{
-	//	log(Log, "Read vid byte 0x%x : %x", addr32, RAM[addr32]);
-	//}
-
-	addr32 &= 0xFFFFF;
-	if ((addr32 >= 0xA0000) && (addr32 <= 0xBFFFF)) 
-	{
-		if ((vm.video.vidmode == 0xD) || (vm.video.vidmode == 0xE) || (vm.video.vidmode == 0x10) || (vm.video.vidmode == 0x12))
-		{
-			return (vm.video.readVGA(addr32 - 0xA0000));
-		}
-		else if ((vm.video.vidmode != 0x13) && (vm.video.vidmode != 0x12) && (vm.video.vidmode != 0xD))
-		{
-			return (RAM[addr32]);
-		}
-		else if ((vm.video.VGA_SC[4] & 6) == 0)
-		{
-			return (RAM[addr32]);
-		}
-		else if(addr32 < 0xB0000)
-		{
-			return (vm.video.readVGA(addr32 - 0xA0000));
-		}
-	}
-
 	if (!vm.cpu.didbootstrap) 
 	{
 		RAM[0x410] = 0x41; //ugly hack to make BIOS always believe we have an EGA/VGA card installed
@@ -141,6 +98,22 @@ uint8_t Memory::readByte(uint32_t addr32)
 		// VGA active
 		//RAM[0x489] = 0x01;
 	}
+}
+
+uint8_t Memory::readByte(uint32_t addr32) 
+{
+	//if (addr32 >= 0xC0000UL && addr32 < 0xC0000UL + 0x8000)
+	//{
+	//	log(Log, "Read vid byte 0x%x : %x", addr32, RAM[addr32]);
+	//}
+
+	addr32 &= 0xFFFFF;
+	if ((addr32 >= 0xA0000) && (addr32 <= 0xBFFFF)) 
+	{
+		return (vm.video.*vm.video.memoryRead)(addr32);
+	}
+
+	applyBootstrapHacks();
 
 	return (RAM[addr32]);
 }
@@ -169,3 +142,109 @@ uint32_t Memory::loadBinary(uint32_t addr32, DiskInterface* file, uint8_t roflag
 
 	return fileSize;
 }
+
+// End of the region of the address space addr32 is in, so a block transfer
+// can treat everything up to it the same way
+static inline uint32_t regionEnd(uint32_t addr32)
+{
+	if (addr32 < 0xA0000)
+		return 0xA0000;
+	if (addr32 < 0xC0000)
+		return 0xC0000;
+	return 0x100000;
+}
+
+// Copies into guest memory with the same rules as writeByte, deciding them
+// once per region rather than once per byte. Conventional memory is copied
+// straight into RAM around any read-only bytes, the video window goes through
+// writeByte so the video card and renderer see every write, and the ROM area
+// above it is left alone
+void Memory::writeBlock(uint32_t addr32, const uint8_t* data, uint32_t length)
+{
+	while (length)
+	{
+		addr32 &= 0xFFFFF;
+		uint32_t span = regionEnd(addr32) - addr32;
+		if (span > length)
+			span = length;
+
+		if (addr32 < 0xA0000)
+		{
+			uint32_t n = 0;
+
+			while (n < span)
+			{
+				if (readonly[addr32 + n])
+				{
+					n++;
+					continue;
+				}
+
+				uint32_t end = n + 1;
+				while (end < span && !readonly[addr32 + end])
+					end++;
+
+				MemUtils::memcpy(&RAM[addr32 + n], data + n, end - n);
+#ifdef CPU_ADDR_MODE_CACHE
+				memset(&addrcachevalid[addr32 + n], 0, end - n);
+#endif
+				if (vm.debugger)
+				{
+					for (uint32_t offset = n; offset < end; offset++)
+						vm.debugger->onMemoryWrite(addr32 + offset);
+				}
+				n = end;
+			}
+		}
+		else if (addr32 < 0xC0000)
+		{
+			for (uint32_t n = 0; n < span; n++)
+				writeByte(addr32 + n, data[n]);
+		}
+
+		addr32 += span;
+		data += span;
+		length -= span;
+	}
+}
+
+void Memory::readBlock(uint32_t addr32, uint8_t* data, uint32_t length)
+{
+	applyBootstrapHacks();
+
+	while (length)
+	{
+		addr32 &= 0xFFFFF;
+		uint32_t span = regionEnd(addr32) - addr32;
+		if (span > length)
+			span = length;
+
+		if (addr32 >= 0xA0000 && addr32 < 0xC0000)
+		{
+			for (uint32_t n = 0; n < span; n++)
+				data[n] = (vm.video.*vm.video.memoryRead)(addr32 + n);
+		}
+		else
+		{
+			MemUtils::memcpy(data, &RAM[addr32], span);
+		}
+
+		addr32 += span;
+		data += span;
+		length -= span;
+	}
+}
+
+const uint8_t* Memory::getReadPointer(uint32_t addr32, uint32_t length, uint8_t* scratch)
+{
+	addr32 &= 0xFFFFF;
+
+	if (addr32 + length <= regionEnd(addr32) && (addr32 < 0xA0000 || addr32 >= 0xC0000))
+	{
+		applyBootstrapHacks();
+		return &RAM[addr32];
+	}
+
+	readBlock(addr32, scratch, length);
+	return scratch;
+}
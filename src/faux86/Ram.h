@@ -40,12 +40,23 @@ namespace Faux86
 		void writeWord(uint32_t addr32, uint16_t value);
 		void writeByte(uint32_t addr32, uint8_t value);
 
+		// Bulk transfers that behave like a run of readByte / writeByte calls,
+		// wrapping at 1MB and honouring read-only memory and the video window
+		void readBlock(uint32_t addr32, uint8_t* data, uint32_t length);
+		void writeBlock(uint32_t addr32, const uint8_t* data, uint32_t length);
+
+		// Returns guest RAM itself when the range is ordinary memory, otherwise
+		// reads it into scratch and returns that
+		const uint8_t* getReadPointer(uint32_t addr32, uint32_t length, uint8_t* scratch);
+
 		uint32_t loadBinary(uint32_t addr32, DiskInterface* file, uint8_t roflag, uint32_t debugFlags = 0);
 
 		uint8_t* RAM;
 		uint8_t* readonly;
 
 	private:
+		void applyBootstrapHacks();
+
 		VM& vm;
 	};
 }
@@ -23,10 +23,52 @@
 #include "Renderer.h"
 #include "Profiler.h"
 #include "MemUtils.h"
+#include "FrameCapture.h"
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RENDERER_AVX2
+#endif
 
 using namespace Faux86;
 
-Mutex Renderer::screenMutex;
+
+// Expands a plane byte into 8 pixels of one bit each, pixels 0-3 in the first
+// word and 4-7 in the second, one pixel per byte from the least significant up
+static uint32_t planarExpandTable[256][2];
+
+// Tandy/PCjr 4bpp bytes, two pixels each. Mode 8 shows every pixel four
+// times (8 output pixels per byte), mode 9 twice (4 output pixels)
+static uint32_t tandy160ExpandTable[256][2];
+static uint32_t tandy320ExpandTable[256];
+
+static void buildExpandTables()
+{
+	for (uint32_t value = 0; value < 256; value++)
+	{
+		planarExpandTable[value][0] = planarExpandTable[value][1] = 0;
+		for (uint32_t pixel = 0; pixel < 8; pixel++)
+		{
+			uint32_t bit = (value >> (7 - pixel)) & 1;
+			planarExpandTable[value][pixel >> 2] |= bit << ((pixel & 3) * 8);
+		}
+
+		uint32_t left = value >> 4, right = value & 15;
+		tandy160ExpandTable[value][0] = left * 0x01010101;
+		tandy160ExpandTable[value][1] = right * 0x01010101;
+		tandy320ExpandTable[value] = left * 0x0101 | right * 0x01010000;
+	}
+}
+
+// Stores four pixels packed one per byte from the least significant up
+static inline void storePixels(uint8_t* dest, uint32_t pixels)
+{
+	dest[0] = (uint8_t) pixels;
+	dest[1] = (uint8_t) (pixels >> 8);
+	dest[2] = (uint8_t) (pixels >> 16);
+	dest[3] = (uint8_t) (pixels >> 24);
+}
 
 void setwindowtitle (const char *extra) 
 {
@@ -44,25 +86,133 @@ void setwindowtitle (const char *extra)
 
 void Renderer::markScreenModeChanged(uint32_t newWidth, uint32_t newHeight)
 {
-	refreshTextMode();
+	invalidate();
 	screenModeChanged = true;
 	nativeWidth = newWidth;
 	nativeHeight = newHeight;
+	liveTarget.width = newWidth;
+	liveTarget.height = newHeight;
+}
+
+// Called by the BIOS mode set. Picks the line renderer and works out which
+// bytes of video memory each surface line shows in the interleaved CGA,
+// Hercules and Tandy modes, so neither is decided again per scanline
+void Renderer::setMode(const VideoModeInfo* mode)
+{
+	if (!mode)
+	{
+		lineRenderer = nullptr;
+		markScreenModeChanged(640, 400);
+		return;
+	}
+
+	switch (mode->render)
+	{
+	case VideoModeInfo::Render::CGA2bpp:		lineRenderer = &Renderer::renderCGA2bppLine; break;
+	case VideoModeInfo::Render::CGA1bpp:		lineRenderer = &Renderer::renderCGA1bppLine; break;
+	case VideoModeInfo::Render::Hercules:		lineRenderer = &Renderer::renderHerculesLine; break;
+	case VideoModeInfo::Render::Tandy160:		lineRenderer = &Renderer::renderTandy160Line; break;
+	case VideoModeInfo::Render::Tandy320:		lineRenderer = &Renderer::renderTandy320Line; break;
+	case VideoModeInfo::Render::Planar:			lineRenderer = &Renderer::renderPlanarLine; break;
+	case VideoModeInfo::Render::PlanarDoubled:	lineRenderer = &Renderer::renderPlanarDoubledLine; break;
+	case VideoModeInfo::Render::VGA256:			lineRenderer = &Renderer::renderVGA256Line; break;
+	default:									lineRenderer = nullptr; break;
+	}
+
+	planarRowBytes = mode->width / 8;
+
+	for (uint32_t y = 0; y < MaxLines; y++)
+	{
+		uint32_t row = y >> 1;	// Source row of the line doubled modes
+
+		switch (mode->render)
+		{
+		case VideoModeInfo::Render::CGA2bpp:
+			rowOffsets[y] = (y >> 1) * 80 + (y & 1) * 8192;
+			break;
+		case VideoModeInfo::Render::CGA1bpp:
+		case VideoModeInfo::Render::Tandy160:
+			rowOffsets[y] = (row >> 1) * 80 + (row & 1) * 8192;
+			break;
+		case VideoModeInfo::Render::Hercules:
+			rowOffsets[y] = (y >> 2) * 90 + (y & 3) * 8192;
+			break;
+		case VideoModeInfo::Render::Tandy320:
+			rowOffsets[y] = (row >> 2) * 160 + (row & 3) * 8192;
+			break;
+		default:
+			rowOffsets[y] = 0;
+			break;
+		}
+	}
+
+	markScreenModeChanged(mode->width, mode->height);
+}
+
+// Fills a byte to four pixel table for the 2bpp CGA modes from the current
+// palette register and background
+void Renderer::buildCGAExpandTable(uint32_t* table) const
+{
+	uint8_t colourSelect = vm.ports.portram[0x3D9];
+	uint8_t colours[4];
+
+	if (vm.video.vidmode == 4)
+	{
+		uint32_t usepal = (colourSelect >> 5) & 1;
+		uint32_t intensity = ((colourSelect >> 4) & 1) << 3;
+		colours[0] = vm.video.cgabg;
+		for (uint32_t n = 1; n < 4; n++)
+			colours[n] = (uint8_t)(n * 2 + usepal + intensity);
+	}
+	else
+	{
+		for (uint32_t n = 0; n < 4; n++)
+			colours[n] = (uint8_t)(n * 63);
+	}
+
+	for (uint32_t value = 0; value < 256; value++)
+	{
+		table[value] = colours[value >> 6] | (colours[(value >> 4) & 3] << 8)
+			| (colours[(value >> 2) & 3] << 16) | ((uint32_t) colours[value & 3] << 24);
+	}
+}
+
+// The 2bpp CGA colours depend on the palette register and background, so a
+// table is rebuilt whenever either changes from what it was built with
+void Renderer::updateCGAExpandTable(uint32_t* table, uint32_t& key)
+{
+	uint8_t colourSelect = vm.ports.portram[0x3D9];
+	uint32_t newKey = vm.video.vidmode | ((colourSelect & 0x30) << 8) | (vm.video.cgabg << 16);
+
+	if (newKey == key)
+		return;
+
+	key = newKey;
+	buildCGAExpandTable(table);
 }
 
 Renderer::Renderer(VM& inVM)
 	: vm(inVM)
 {
-	scalemap = nullptr;
 }
 
 Renderer::~Renderer()
 {
-	delete[] scalemap;
+	delete[] glyphAtlas;
 	if (renderSurface && renderSurface != hostSurface)
 	{
 		RenderSurface::destroy(renderSurface);
 	}
+
+	if (rasterFrames)
+	{
+		for (uint32_t n = 0; n < SurfaceSwapChain::BufferCount; n++)
+		{
+			delete[] rasterFrames[n].colours;
+		}
+		delete[] rasterFrames;
+	}
+	delete rasterChain;
 }
 
 void Renderer::init()
@@ -74,27 +224,58 @@ void Renderer::init()
 	//fb->init(1920, 1080);
 	//fb->init(1024, 1024);
 
-	hostSurface = fb->getSurface();
+	swapChain = fb->getSwapChain();
+	hostSurface = swapChain ? swapChain->getBackBuffer() : fb->getSurface();
+	MemUtils::memset(staleLines, 1, sizeof(staleLines));
 
-#ifdef DOUBLE_BUFFER
-	renderSurface = RenderSurface::create(1024, 1024);
-#else
-	renderSurface = hostSurface;
-#endif
+	// Emulated video is always drawn as palette indices, so 32 bit hosts get
+	// their own indexed surface that is resolved to colour when blitted. So do
+	// swap chains, which need a complete frame to refresh older buffers from
+	if (hostSurface->format == RenderSurface::Format::Indexed8 && !swapChain)
+		renderSurface = hostSurface;
+	else
+		renderSurface = RenderSurface::create(1024, 1024);
+
+	liveTarget.surface = renderSurface;
+	liveTarget.layout = &unchained;
+	liveTarget.cgaTable = cgaExpandTable;
+
+	if (vm.config.rasterMode)
+	{
+		rasterChain = new SurfaceSwapChain(MaxSurfaceWidth, MaxLines, RenderSurface::Format::Indexed8);
+		rasterFrames = new RasterFrame[SurfaceSwapChain::BufferCount];
+
+		// Indexed hosts show a whole frame with one palette, so only 32 bit
+		// hosts can show the colours a line was actually drawn with
+		if (hostSurface->format == RenderSurface::Format::RGBA8888)
+		{
+			for (uint32_t n = 0; n < SurfaceSwapChain::BufferCount; n++)
+			{
+				rasterFrames[n].colours = new uint32_t[MaxLines][256];
+			}
+		}
+
+		rasterTarget.layout = &rasterLayout;
+		rasterTarget.cgaTable = rasterCGATable;
+	}
 
 	createScaleMap();
+	buildExpandTables();
 
-	refreshTextMode();
+	invalidate();
 
 	//sprintf (windowtitle, "%s", BUILD_STRING);
 	//setwindowtitle ("");
 
-	InitMutex(screenMutex);
-
-
 	vm.taskManager.addTask(new RenderTask(*this));
 }
 
+void Renderer::invalidate()
+{
+	refreshTextMode();
+	MemUtils::memset(dirtyLines, 1, sizeof(dirtyLines));
+}
+
 void Renderer::refreshTextMode()
 {
 	for (unsigned n = 0; n < MaxColumns * MaxRows; n++)
@@ -106,26 +287,22 @@ void Renderer::refreshTextMode()
 void Renderer::createScaleMap()
 {
 	log(LogVerbose, "Creating scale map");
-	if (!scalemap)
+
+	MemUtils::memset(columnRuns, 0, sizeof(columnRuns));
+	MemUtils::memset(rowRuns, 0, sizeof(rowRuns));
+
+	for (uint32_t dstx = 0; dstx < hostSurface->width; dstx++)
 	{
-		scalemap = new uint32_t[(hostSurface->width + 1) * hostSurface->height];
+		uint32_t srcx = dstx * nativeWidth / hostSurface->width;
+		if (srcx < MaxSurfaceWidth)
+			columnRuns[srcx]++;
 	}
 
-	uint32_t srcx, srcy, dstx, dsty, scalemapptr;
-	double xscale, yscale;
-
-	xscale = (double) nativeWidth / (double) hostSurface->width;
-	yscale = (double) nativeHeight / (double) hostSurface->height;
-	scalemapptr = 0;
-	for (dsty=0; dsty<(uint32_t)hostSurface->height; dsty++) 
+	for (uint32_t dsty = 0; dsty < hostSurface->height; dsty++)
 	{
-		srcy = (uint32_t) ( (double) dsty * yscale);
-		scalemap[scalemapptr++] = srcy;
-		for (dstx=0; dstx<(uint32_t)hostSurface->width; dstx++) 
-		{
-			srcx = (uint32_t) ( (double) dstx * xscale);
-			scalemap[scalemapptr++] = srcx;
-		}
+		uint32_t srcy = dsty * nativeHeight / hostSurface->height;
+		if (srcy < MaxLines)
+			rowRuns[srcy]++;
 	}
 }
 
@@ -133,6 +310,16 @@ void RenderTask::begin()
 {
 	cursorprevtick = (uint32_t) vm.timing.getMS();
 	vm.video.cursorvisible = 0;
+
+	lastRetrace = vm.timing.getRetraceCount();
+	lastFrameTime = vm.timing.getTicks();
+}
+
+void RenderTask::drawFrame()
+{
+	renderer.draw();
+	renderer.frameStats.rendered++;
+	vm.video.updatedscreen = false;
 }
 
 int RenderTask::update()
@@ -150,46 +337,54 @@ int RenderTask::update()
 		vm.renderer.markTextDirty(vm.renderer.cursorX, vm.renderer.cursorY);
 	}
 
-	uint64_t drawStartTime = vm.timing.getTicks();
-
-	//if (vm.video.updatedscreen || vm.config.renderBenchmark)
-	//{
-	//	vm.video.updatedscreen = 0;
-	//	if (renderer.fb != nullptr)
-	//	{
-	//		renderer.draw();
-	//	}
-	//	renderer.totalframes++;
-	//}
-
-	if (vm.video.updatedscreen)
+	if (vm.config.renderOnRequest)
 	{
-		renderer.draw();
-		renderer.fb->setPalette(vm.video.getCurrentPalette());
-		vm.video.updatedscreen = false;
+		if (renderer.frameRequested)
+		{
+			renderer.frameRequested = false;
+			drawFrame();
+		}
+		return 1;
 	}
 
-	constexpr int targetTime = 16;		// 16 ms
-	int delayTime = targetTime - (int)vm.timing.getElapsedMS(drawStartTime);
+	// Frames are drawn once the guest reaches its vertical retrace, so it has
+	// finished updating the screen, and no faster than the target refresh
+	uint64_t hostFreq = vm.timing.getHostFreq();
+	uint64_t frameTicks = hostFreq / vm.config.refreshRate;
+	uint64_t now = vm.timing.getTicks();
+	uint64_t elapsed = now - lastFrameTime;
+
+	if (elapsed < frameTicks)
+		return (int)((frameTicks - elapsed) * 1000 / hostFreq) + 1;
+
+	uint32_t retrace = vm.timing.getRetraceCount();
+	if (retrace == lastRetrace)
+		return 1;
 
-	if (delayTime < 1)
-		delayTime = 1;
-	if (delayTime > targetTime)
-		delayTime = targetTime;
+	// Fewer retraces than real time allows means the CPU is not keeping up,
+	// so the time a draw would take is better spent emulating
+	uint64_t expectedRetraces = elapsed * TimingScheduler::RetraceRate / hostFreq;
+	bool behind = (uint64_t)(retrace - lastRetrace) * 10 < expectedRetraces * 9;
 
-	return delayTime;
-	
+	lastRetrace = retrace;
+	lastFrameTime = now;
 
-	//if (!vm.config.renderBenchmark)
-	//{
-	//	delaycalc = vm.config.frameDelay - (uint32_t)(vm.timing.getMS() - cursorcurtick);
-	//	if (delaycalc > vm.config.frameDelay) 
-	//		delaycalc = vm.config.frameDelay;
-	//	return delaycalc;
-	//}
-	//
-	//
-	//return 0;
+	int frameTime = (int)(frameTicks * 1000 / hostFreq);
+
+	if (!vm.video.updatedscreen)
+		return frameTime;
+
+	if (behind && framesSkipped < MaxFrameSkip)
+	{
+		framesSkipped++;
+		renderer.frameStats.skipped++;
+		return frameTime;
+	}
+
+	framesSkipped = 0;
+	drawFrame();
+
+	return frameTime;
 }
 
 void Renderer::setCursorPosition(uint32_t x, uint32_t y)
@@ -281,6 +476,59 @@ void Renderer::stretchBlit ()
 	roughBlit();
 }
 
+// Resolves each palette entry to a host RGBA pixel
+static void resolvePalette(const Palette* palette, uint32_t* lut)
+{
+	for (int n = 0; n < 256; n++)
+	{
+		const Palette::Entry& colour = palette->colours[n];
+		lut[n] = ((uint32_t)colour.r << 24) | ((uint32_t)colour.g << 16) | ((uint32_t)colour.b << 8) | 0xFF;
+	}
+}
+
+// Rebuilds the RGBA lookup table if the current palette has been switched
+// or written since it was last built. Returns true if it changed
+bool Renderer::updatePaletteLUT()
+{
+	const Palette* palette = vm.video.getCurrentPalette();
+
+	if (palette == lutPalette && palette->revision == lutRevision)
+		return false;
+
+	resolvePalette(palette, paletteLUT);
+
+	lutPalette = palette;
+	lutRevision = palette->revision;
+	return true;
+}
+
+// Resolves a line of palette indices to RGBA pixels through a lookup table
+static void convertLine(uint32_t* dest, const uint8_t* src, uint32_t count, const uint32_t* lut)
+{
+	uint32_t n = 0;
+
+#if defined(RENDERER_AVX2)
+	for (; n + 8 <= count; n += 8)
+	{
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + n)));
+		_mm256_storeu_si256((__m256i*)(dest + n), _mm256_i32gather_epi32((const int*) lut, indices, 4));
+	}
+#endif
+
+	for (; n + 4 <= count; n += 4)
+	{
+		dest[n] = lut[src[n]];
+		dest[n + 1] = lut[src[n + 1]];
+		dest[n + 2] = lut[src[n + 2]];
+		dest[n + 3] = lut[src[n + 3]];
+	}
+
+	for (; n < count; n++)
+	{
+		dest[n] = lut[src[n]];
+	}
+}
+
 void Renderer::simpleBlit()
 {
 	//ProfileBlock block(vm.timing, "Renderer::simpleBlit");
@@ -290,65 +538,166 @@ void Renderer::simpleBlit()
 
 		for (uint32_t y = 0; y < hostSurface->height; y++)
 		{
-			MemUtils::memcpy(hostSurface->pixels + (y * hostSurface->pitch), renderSurface->pixels + (y * renderSurface->pitch), hostSurface->width);
+			if (!drawLines[y])
+				continue;
+			if (hostSurface->format == RenderSurface::Format::RGBA8888)
+				convertLine((uint32_t*)(hostSurface->pixels + (y * hostSurface->pitch)), renderSurface->pixels + (y * renderSurface->pitch), hostSurface->width, lineLUT(y));
+			else
+				memcpy(hostSurface->pixels + (y * hostSurface->pitch), renderSurface->pixels + (y * renderSurface->pitch), hostSurface->width);
 		}
 	}
 }
 
-void Renderer::roughBlit () 
+// Expands a line of palette indices by an integer factor, storing a word at a time
+static void expandLine8(uint8_t* dest, const uint8_t* src, uint32_t count, uint32_t scale)
 {
-	uint32_t srcx, srcy, dstx, dsty, scalemapptr;
-	uint8_t* pixels = hostSurface->pixels;
-	uint32_t pitch = hostSurface->pitch;
-	uint32_t width = hostSurface->width;
-	uint32_t height = hostSurface->height;
+	uint32_t x = 0;
+	uint32_t* dest32 = (uint32_t*) dest;
 
+	switch (scale)
 	{
-		scalemapptr = 0;
-		for (dsty = 0; dsty < height; dsty++)
+	case 1:
+		memcpy(dest, src, count);
+		return;
+	case 2:
+		for (; x + 2 <= count; x += 2)
 		{
-			srcy = scalemap[scalemapptr++];
-			uint8_t* dstPtr = pixels + dsty * pitch;
+			*dest32++ = (src[x] * 0x0101u) | (src[x + 1] * 0x01010000u);
+		}
+		break;
+	case 3:
+		for (; x + 4 <= count; x += 4)
+		{
+			dest32[0] = (src[x] * 0x010101u) | ((uint32_t)src[x + 1] << 24);
+			dest32[1] = (src[x + 1] * 0x0101u) | (src[x + 2] * 0x01010000u);
+			dest32[2] = src[x + 2] | (src[x + 3] * 0x01010100u);
+			dest32 += 3;
+		}
+		break;
+	case 4:
+		for (; x < count; x++)
+		{
+			*dest32++ = src[x] * 0x01010101u;
+		}
+		break;
+	}
 
-			for (dstx = 0; dstx < width; dstx++)
-			{
-				srcx = scalemap[scalemapptr++];
-				*dstPtr++ = renderSurface->get(srcx, srcy);
-			}
+	for (dest = (uint8_t*) dest32; x < count; x++)
+	{
+		for (uint32_t n = 0; n < scale; n++)
+		{
+			*dest++ = src[x];
 		}
 	}
 }
 
-/* NOTE: doubleblit is only used when smoothing is not enabled, and the SDL window size
-         is exactly double of native resolution for the current video mode. we can take
-         advantage of the fact that every pixel is simply doubled both horizontally and
-         vertically. this way, we do not need to waste mountains of CPU time doing
-         floating point multiplication for each and every on-screen pixel. it makes the
-         difference between games being smooth and playable, and being jerky on my old
-         400 MHz PowerPC G3 iMac.
-*/
-void Renderer::doubleBlit () 
+// Resolves and expands a line of palette indices to RGBA pixels by an integer factor
+static void expandLine32(uint32_t* dest, const uint8_t* src, uint32_t count, uint32_t scale, const uint32_t* lut)
+{
+	switch (scale)
+	{
+	case 2:
+		for (uint32_t x = 0; x < count; x++, dest += 2)
+		{
+			dest[0] = dest[1] = lut[src[x]];
+		}
+		break;
+	case 3:
+		for (uint32_t x = 0; x < count; x++, dest += 3)
+		{
+			dest[0] = dest[1] = dest[2] = lut[src[x]];
+		}
+		break;
+	case 4:
+		for (uint32_t x = 0; x < count; x++, dest += 4)
+		{
+			dest[0] = dest[1] = dest[2] = dest[3] = lut[src[x]];
+		}
+		break;
+	}
+}
+
+// Used when the host is an exact 1-4x multiple of the native resolution in
+// each direction. Each line is expanded once and then copied to the rows below
+void Renderer::integerBlit(uint32_t xScale, uint32_t yScale)
+{
+	uint32_t pitch = hostSurface->pitch;
+	bool rgba = hostSurface->format == RenderSurface::Format::RGBA8888;
+	uint32_t rowBytes = rgba ? hostSurface->width * sizeof(uint32_t) : hostSurface->width;
+
+	for (uint32_t srcy = 0; srcy < nativeHeight && srcy < MaxLines; srcy++)
+	{
+		if (!drawLines[srcy])
+			continue;
+
+		const uint8_t* src = renderSurface->pixels + srcy * renderSurface->pitch;
+		uint8_t* dest = hostSurface->pixels + srcy * yScale * pitch;
+
+		if (!rgba)
+			expandLine8(dest, src, nativeWidth, xScale);
+		else if (xScale == 1)
+			convertLine((uint32_t*) dest, src, nativeWidth, lineLUT(srcy));
+		else
+			expandLine32((uint32_t*) dest, src, nativeWidth, xScale, lineLUT(srcy));
+
+		for (uint32_t n = 1; n < yScale; n++)
+		{
+			memcpy(dest + n * pitch, dest, rowBytes);
+		}
+	}
+}
+
+// Nearest neighbour scaling to any size. Each source pixel is written as a
+// run across the columns it covers and finished rows are copied downwards
+void Renderer::roughBlit () 
 {
-	uint32_t srcx, srcy, dstx, dsty, curcolor;
-	int32_t ofs;
-	uint8_t* pixels = hostSurface->pixels;
 	uint32_t pitch = hostSurface->pitch;
-	uint32_t width = hostSurface->width;
-	uint32_t height = hostSurface->height;
+	bool rgba = hostSurface->format == RenderSurface::Format::RGBA8888;
+	uint32_t rowBytes = rgba ? hostSurface->width * sizeof(uint32_t) : hostSurface->width;
+	uint32_t width = nativeWidth < MaxSurfaceWidth ? nativeWidth : MaxSurfaceWidth;
+	uint8_t* destRow = hostSurface->pixels;
 
-	for (dsty=0; dsty<height; dsty += 2) 
+	for (uint32_t srcy = 0; srcy < nativeHeight && srcy < MaxLines; srcy++)
 	{
-		srcy = (uint32_t) (dsty >> 1);
-		ofs = dsty * pitch;
-		for (dstx=0; dstx < width; dstx += 2) 
+		uint32_t rows = rowRuns[srcy];
+
+		if (rows && drawLines[srcy])
 		{
-			srcx = (uint32_t) (dstx >> 1);
-			curcolor = renderSurface->get(srcx, srcy);
-			pixels [ofs+pitch] = curcolor;
-			pixels [ofs++] = curcolor;
-			pixels [ofs+pitch] = curcolor;
-			pixels [ofs++] = curcolor;
+			const uint8_t* src = renderSurface->pixels + srcy * renderSurface->pitch;
+
+			if (rgba)
+			{
+				uint32_t* dest = (uint32_t*) destRow;
+				const uint32_t* lut = lineLUT(srcy);
+				for (uint32_t srcx = 0; srcx < width; srcx++)
+				{
+					uint32_t colour = lut[src[srcx]];
+					for (uint32_t n = columnRuns[srcx]; n > 0; n--)
+					{
+						*dest++ = colour;
+					}
+				}
+			}
+			else
+			{
+				uint8_t* dest = destRow;
+				for (uint32_t srcx = 0; srcx < width; srcx++)
+				{
+					uint8_t colour = src[srcx];
+					for (uint32_t n = columnRuns[srcx]; n > 0; n--)
+					{
+						*dest++ = colour;
+					}
+				}
+			}
+
+			for (uint32_t n = 1; n < rows; n++)
+			{
+				memcpy(destRow + n * pitch, destRow, rowBytes);
+			}
 		}
+
+		destRow += rows * pitch;
 	}
 }
 
@@ -365,31 +714,156 @@ void Renderer::onMemoryWrite(uint32_t address, uint8_t value)
 	}
 	else
 	{
-		/*switch (vm.video.vidmode)
-		{
-			case 0x13:	// 320x200 256 colour
-			{
-				bool isPlaneMode = (vm.video.VGA_SC[4] & 6) != 0;
+		// Map the write back to the scanlines it affects in RAM backed modes.
+		// Planar modes are reported through onVRAMWrite instead.
+		uint32_t rel;
 
-				if (!isPlaneMode)
+		switch (vm.video.vidmode)
+		{
+			case 4:
+			case 5:
+				rel = address - vm.video.videobase;
+				if (rel < 0x4000)
+					markLineDirty(((rel & 0x1FFF) / 80) * 2 + (rel >> 13));
+				break;
+			case 6:
+				rel = address - vm.video.videobase;
+				if (rel < 0x4000)
 				{
-					uint32_t relAddress = address - vm.video.videobase - vm.video.vgapage;
-					if (relAddress < 320 * 200)
-					{
-						uint32_t y = relAddress / 320;
-						uint32_t x = relAddress % 320;
-						renderSurface->set(x, y, value);
-					}
+					uint32_t y = (((rel & 0x1FFF) / 80) * 2 + (rel >> 13)) * 2;
+					markLineDirty(y);
+					markLineDirty(y + 1);
 				}
-				else
+				break;
+			case 127:
+				rel = address - vm.video.videobase;
+				if (rel < 0x8000)
+					markLineDirty(((rel & 0x1FFF) / 90) * 4 + (rel >> 13));
+				break;
+			case 0x8:
+				rel = address - 0xB8000;
+				if (rel < 0x4000)
 				{
-					// TODO
+					uint32_t y = ((rel & 0x1FFF) / 80) * 4 + (rel >> 13) * 2;
+					markLineDirty(y);
+					markLineDirty(y + 1);
 				}
-			}
+				break;
+			case 0x9:
+				rel = address - 0xB8000;
+				if (rel < 0x8000)
+				{
+					uint32_t y = ((rel & 0x1FFF) / 160) * 8 + (rel >> 13) * 2;
+					markLineDirty(y);
+					markLineDirty(y + 1);
+				}
+				break;
+			case 0x13:
+				if (!(vm.video.VGA_SC[4] & 6))
+				{
+					rel = (address - vm.video.videobase - vm.video.vgapage) & 0xFFFF;
+					markLineDirty(rel / 320);
+				}
+				break;
+		}
+	}
+}
+
+// Marks every text cell touched by a bulk update of text memory
+void Renderer::onTextRangeWrite(uint32_t address, uint32_t length)
+{
+	uint32_t base = vm.video.vgapage + vm.video.videobase;
+	uint32_t end = base + vm.video.cols * vm.video.rows * 2;
+	uint32_t first = address > base ? address : base;
+	uint32_t last = address + length < end ? address + length : end;
+
+	if (first >= last)
+		return;
+
+	for (uint32_t cell = (first - base) / 2; cell < (last - base + 1) / 2 && cell < MaxColumns * MaxRows; cell++)
+	{
+		textModeDirtyFlag[cell] = 1;
+	}
+}
+
+void Renderer::onVRAMWrite(uint32_t offset)
+{
+	switch (vm.video.vidmode)
+	{
+		case 0xD:
+			markLineDirty(((offset - vm.video.vgapage) & 0xFFFF) / 40);
+			break;
+		case 0xE:
+		{
+			uint32_t y = (((offset - vm.video.vgapage) & 0xFFFF) / 80) * 2;
+			markLineDirty(y);
+			markLineDirty(y + 1);
+			break;
+		}
+		case 0x10:
+		case 0x12:
+			markLineDirty(((offset - vm.video.vgapage) & 0xFFFF) / 80);
+			break;
+		case 0x13:
+		{
+			// Writes to a page that is not on screen need no redraw
+			uint32_t row = ((offset - vm.video.vgapage) & 0xFFFF) / unchained.rowAddresses;
+			if (row < unchained.splitRow && row < unchained.height)
+				markLineDirty(row);
+			row = unchained.splitRow + offset / unchained.rowAddresses;
+			if (row < unchained.height)
+				markLineDirty(row);
 			break;
-		}*/
+		}
+	}
+}
+
+// Pre-scales the font to the current cell size so text cells can be drawn
+// without per pixel divides or attribute branches
+void Renderer::buildGlyphAtlas(uint32_t glyphWidth, uint32_t glyphHeight)
+{
+	const uint8_t* fontData = vm.video.fontcga;
+
+	delete[] glyphAtlas;
+	glyphAtlas = new uint8_t[256 * glyphWidth * glyphHeight];
+
+	uint8_t* out = glyphAtlas;
+	for (uint32_t glyph = 0; glyph < 256; glyph++)
+	{
+		for (uint32_t j = 0; j < glyphHeight; j++)
+		{
+			uint32_t glyphRow = j * 16 / glyphHeight;
+			for (uint32_t i = 0; i < glyphWidth; i++)
+			{
+				uint32_t glyphCol = i * 8 / glyphWidth;
+				*out++ = fontData[glyph * 128 + glyphRow * 8 + glyphCol] ? 0xFF : 0x00;
+			}
+		}
 	}
 
+	atlasGlyphWidth = glyphWidth;
+	atlasGlyphHeight = glyphHeight;
+	atlasFont = fontData;
+	refreshTextMode();
+}
+
+void Renderer::getTextColours(uint8_t attr, uint8_t& foreground, uint8_t& background) const
+{
+	if (vm.video.vidcolor)
+	{
+		foreground = attr & 15;
+		background = attr / 16; //high intensity background
+	}
+	else if (attr & 0x70)
+	{
+		foreground = 0;
+		background = 7;
+	}
+	else
+	{
+		foreground = 7;
+		background = 0;
+	}
 }
 
 void Renderer::renderTextMode()
@@ -397,9 +871,13 @@ void Renderer::renderTextMode()
 	uint32_t glyphWidth = 640 / vm.video.cols;
 	uint32_t glyphHeight = 400 / vm.video.rows;
 	uint32_t outX = 0, outY = 0;
-	uint8_t* fontData = vm.video.fontcga;
 	uint8_t* RAM = vm.memory.RAM;
 
+	if (glyphWidth != atlasGlyphWidth || glyphHeight != atlasGlyphHeight || vm.video.fontcga != atlasFont)
+	{
+		buildGlyphAtlas(glyphWidth, glyphHeight);
+	}
+
 	for (uint32_t row = 0; row < vm.video.rows; row++)
 	{
 		for (uint32_t col = 0; col < vm.video.cols; col++)
@@ -409,47 +887,29 @@ void Renderer::renderTextMode()
 			if (isDirty)
 			{
 				textModeDirtyFlag[row * vm.video.cols + col] = 0;
+				for (uint32_t j = 0; j < glyphHeight; j++)
+				{
+					drawLines[outY + j] = 1;
+				}
 
 				uint32_t vidptr = vm.video.vgapage + vm.video.videobase + row * vm.video.cols * 2 + col * 2;
 				uint8_t curchar = RAM[vidptr];
+				uint8_t attr = RAM[vidptr + 1];
+				uint8_t foreground, background;
+				getTextColours(attr, foreground, background);
+
+				// Each glyph pixel is a 0x00/0xFF mask selecting between the two colours
+				const uint8_t* glyph = &glyphAtlas[curchar * glyphWidth * glyphHeight];
+				uint8_t difference = foreground ^ background;
 
 				for (uint32_t j = 0; j < glyphHeight; j++)
 				{
+					uint8_t* dest = &renderSurface->pixels[outY * renderSurface->pitch + outX];
 					for (uint32_t i = 0; i < glyphWidth; i++)
 					{
-						uint32_t glyphRow = j * 16 / glyphHeight;
-						uint32_t glyphCol = i * 8 / glyphWidth;
-						uint8_t glyphData = fontData[curchar * 128 + glyphRow * 8 + glyphCol];
-						uint8_t color;
-
-						if (vm.video.vidcolor)
-						{
-							if (!glyphData)
-								color = RAM[vidptr + 1] / 16; //high intensity background
-							else
-								color = RAM[vidptr + 1] & 15;
-						}
-						else
-						{
-							if ((RAM[vidptr + 1] & 0x70))
-							{
-								if (!glyphData)
-									color = 7;
-								else
-									color = 0;
-							}
-							else
-							{
-								if (!glyphData)
-									color = 0;
-								else
-									color = 7;
-							}
-						}
-						renderSurface->set(outX, outY, color);
-						outX++;
+						dest[i] = background ^ (difference & glyph[i]);
 					}
-					outX -= glyphWidth;
+					glyph += glyphWidth;
 					outY++;
 				}
 				outY -= glyphHeight;
@@ -469,6 +929,7 @@ void Renderer::renderTextMode()
 		uint32_t y1 = cursorY * 8 + 8 - curheight;
 		for (uint32_t y = y1 * 2; y <= y1 * 2 + curheight - 1; y++)
 		{
+			drawLines[y] = 1;
 			for (uint32_t x = x1; x <= x1 + glyphWidth - 1; x++)
 			{
 				uint8_t color = RAM[vm.video.videobase + cursorY * vm.video.cols * 2 + cursorX * 2 + 1] & 15;
@@ -478,11 +939,456 @@ void Renderer::renderTextMode()
 	}
 }
 
-void Renderer::markTextDirty(uint32_t x, uint32_t y)
+// Converts one line of a 16 colour planar mode, combining a byte from each of
+// the four planes into 8 chunky pixels at a time
+void Renderer::drawPlanarLine(uint8_t* dest, uint32_t vidptr, uint32_t numBytes)
 {
-	if (x < MaxColumns && y < MaxRows)
+	const uint32_t* VRAM = vm.video.VRAM;
+
+	for (uint32_t n = 0; n < numBytes; n++)
 	{
-		textModeDirtyFlag[y * vm.video.cols + x] = 1;
+		// The start address may put the end of a line past the top of the plane
+		uint32_t planes = VRAM[(vidptr + n) & 0xFFFF];
+		const uint32_t* p0 = planarExpandTable[planes & 0xFF];
+		const uint32_t* p1 = planarExpandTable[(planes >> 8) & 0xFF];
+		const uint32_t* p2 = planarExpandTable[(planes >> 16) & 0xFF];
+		const uint32_t* p3 = planarExpandTable[planes >> 24];
+		uint32_t lo = p0[0] | (p1[0] << 1) | (p2[0] << 2) | (p3[0] << 3);
+		uint32_t hi = p0[1] | (p1[1] << 1) | (p2[1] << 2) | (p3[1] << 3);
+
+		storePixels(dest, lo);
+		storePixels(dest + 4, hi);
+		dest += 8;
+	}
+
+#ifdef VERIFY_PLANAR_CONVERSION
+	dest -= numBytes * 8;
+	for (uint32_t x = 0; x < numBytes * 8; x++)
+	{
+		uint32_t ptr = (vidptr + (x >> 3)) & 0xFFFF;
+		uint32_t x1 = 7 - (x & 7);
+		uint8_t color = (vm.video.readPlane(0, ptr) >> x1) & 1;
+		color |= ((vm.video.readPlane(1, ptr) >> x1) & 1) << 1;
+		color |= ((vm.video.readPlane(2, ptr) >> x1) & 1) << 2;
+		color |= ((vm.video.readPlane(3, ptr) >> x1) & 1) << 3;
+		if (dest[x] != color)
+		{
+			log(Log, "Planar conversion mismatch at %u of %04X: %u != %u", x, vidptr, dest[x], color);
+			break;
+		}
+	}
+#endif
+}
+
+// The second line of a line doubled mode is a copy of the first, as long as
+// that was expanded just before into the same surface
+bool Renderer::copyDoubledLine(LineTarget& target, uint32_t y)
+{
+	if ((y & 1) && target.lastExpandedLine == y - 1)
+	{
+		MemUtils::memcpy(&target.surface->pixels[y * target.surface->pitch], &target.surface->pixels[(y - 1) * target.surface->pitch], target.width);
+		target.lastExpandedLine = ~0u;
+		return true;
+	}
+
+	target.lastExpandedLine = y;
+	return false;
+}
+
+// Rasterizes a single render surface line of the current graphics mode
+// using the video state as it stands right now
+void Renderer::renderGraphicsLine(uint32_t y)
+{
+	if (!lineRenderer)
+		return;
+
+	if (lineRenderer == &Renderer::renderCGA2bppLine)
+		updateCGAExpandTable(cgaExpandTable, cgaExpandKey);
+
+	(this->*lineRenderer)(liveTarget, y);
+}
+
+void Renderer::renderCGA2bppLine(LineTarget& target, uint32_t y)
+{
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	const uint8_t* src = &vm.memory.RAM[vm.video.videobase + rowOffsets[y]];
+
+	for (uint32_t x = 0; x < 80; x++) {
+		storePixels(dest + x * 4, target.cgaTable[src[x]]);
+	}
+}
+
+// 640x200 line doubled onto a 400 line surface
+void Renderer::renderCGA1bppLine(LineTarget& target, uint32_t y)
+{
+	if (copyDoubledLine(target, y))
+		return;
+
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	const uint8_t* src = &vm.memory.RAM[vm.video.videobase + rowOffsets[y]];
+
+	for (uint32_t x = 0; x < 80; x++) {
+		storePixels(dest + x * 8, planarExpandTable[src[x]][0] * 15);
+		storePixels(dest + x * 8 + 4, planarExpandTable[src[x]][1] * 15);
+	}
+}
+
+void Renderer::renderHerculesLine(LineTarget& target, uint32_t y)
+{
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	const uint8_t* src = &vm.memory.RAM[vm.video.videobase + rowOffsets[y]];
+
+	for (uint32_t x = 0; x < 90; x++) {
+		storePixels(dest + x * 8, planarExpandTable[src[x]][0] * 15);
+		storePixels(dest + x * 8 + 4, planarExpandTable[src[x]][1] * 15);
+	}
+}
+
+// 160x200 16-color (PCjr)
+void Renderer::renderTandy160Line(LineTarget& target, uint32_t y)
+{
+	if (copyDoubledLine(target, y))
+		return;
+
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	const uint8_t* src = &vm.memory.RAM[vm.video.videobase + rowOffsets[y]];
+
+	for (uint32_t x = 0; x < 80; x++) {
+		storePixels(dest + x * 8, tandy160ExpandTable[src[x]][0]);
+		storePixels(dest + x * 8 + 4, tandy160ExpandTable[src[x]][1]);
+	}
+}
+
+// 320x200 16-color (Tandy/PCjr)
+void Renderer::renderTandy320Line(LineTarget& target, uint32_t y)
+{
+	if (copyDoubledLine(target, y))
+		return;
+
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	const uint8_t* src = &vm.memory.RAM[vm.video.videobase + rowOffsets[y]];
+
+	for (uint32_t x = 0; x < 160; x++) {
+		storePixels(dest + x * 4, tandy320ExpandTable[src[x]]);
+	}
+}
+
+// Value of the CRTC line compare register. The display restarts from address
+// 0 on the scanline after the one it matches
+uint32_t Renderer::decodeLineCompare() const
+{
+	const uint16_t* crtc = vm.video.VGA_CRTC;
+	return crtc[0x18] | ((crtc[7] & 0x10) << 4) | ((crtc[9] & 0x40) << 3);
+}
+
+// Draws one display row of a 16 colour planar mode onto surface line y, with
+// the start address and pel panning as they are now. Rows from splitRow down
+// come from address 0, and are not panned if the attribute controller says so
+void Renderer::drawPlanarRow(LineTarget& target, uint32_t y, uint32_t row, uint32_t splitRow)
+{
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	uint32_t pan = vm.video.VGA_ATTR[0x13] & 7;
+	uint32_t address;
+
+	if (row >= splitRow)
+	{
+		address = (row - splitRow) * planarRowBytes;
+		if (vm.video.VGA_ATTR[0x10] & 0x20)
+			pan = 0;
+	}
+	else
+	{
+		address = vm.video.vgapage + row * planarRowBytes;
+	}
+
+	if (!pan)
+	{
+		drawPlanarLine(dest, address, planarRowBytes);
+		return;
+	}
+
+	// Panning shifts the line left by up to 7 pixels, bringing in the next byte
+	uint8_t panned[MaxSurfaceWidth + 8];
+	uint32_t numBytes = planarRowBytes < MaxSurfaceWidth / 8 ? planarRowBytes : MaxSurfaceWidth / 8;
+	drawPlanarLine(panned, address, numBytes + 1);
+	memcpy(dest, panned + pan, numBytes * 8);
+}
+
+void Renderer::renderPlanarLine(LineTarget& target, uint32_t y)
+{
+	if (y >= target.height)
+		return;
+
+	// Line compare counts scanlines, and 200 line modes are double scanned
+	uint32_t splitScanline = decodeLineCompare() + 1;
+	drawPlanarRow(target, y, y, target.height <= 200 ? (splitScanline + 1) >> 1 : splitScanline);
+}
+
+// 640x200 16-color, line doubled onto a 400 line surface
+void Renderer::renderPlanarDoubledLine(LineTarget& target, uint32_t y)
+{
+	if (copyDoubledLine(target, y))
+		return;
+
+	drawPlanarRow(target, y, y >> 1, (decodeLineCompare() + 2) >> 1);
+}
+
+void Renderer::renderVGA256Line(LineTarget& target, uint32_t y)
+{
+	if (!(vm.video.VGA_SC[4] & 6))
+	{
+		MemUtils::memcpy(&target.surface->pixels[y * target.surface->pitch], &vm.memory.RAM[vm.video.videobase + ((vm.video.vgapage + y*target.width) & 0xFFFF)], target.width);
+	}
+	else
+	{
+		renderUnchainedLine(target, y);
+	}
+}
+
+// Decodes the mode 13h display layout from the CRTC
+Renderer::UnchainedLayout Renderer::decodeUnchainedLayout() const
+{
+	UnchainedLayout layout;
+
+	if (vm.video.VGA_SC[4] & 6)
+	{
+		const uint16_t* crtc = vm.video.VGA_CRTC;
+		uint32_t scanlinesPerRow = ((crtc[9] & 0x1F) + 1) << ((crtc[9] >> 7) & 1);
+		uint32_t displayEnd = (crtc[0x12] | ((crtc[7] & 0x02) << 7) | ((crtc[7] & 0x40) << 3)) + 1;
+		uint32_t verticalTotal = (crtc[6] | ((crtc[7] & 0x01) << 8) | ((crtc[7] & 0x20) << 4)) + 2;
+		uint32_t lineCompare = decodeLineCompare();
+		uint32_t width = ((crtc[1] & 0xFF) + 1) * 4;
+		uint32_t height = (displayEnd < verticalTotal ? displayEnd : verticalTotal) / scanlinesPerRow;
+		uint32_t rowAddresses = (crtc[0x13] & 0xFF) * 2;
+
+		// Left at the defaults if the program has not set up the CRTC at all
+		if (height && rowAddresses)
+		{
+			layout.width = width < MaxSurfaceWidth ? width : MaxSurfaceWidth;
+			layout.height = height < MaxLines ? height : MaxLines;
+			layout.rowAddresses = rowAddresses;
+			layout.splitRow = lineCompare / scanlinesPerRow + 1;
+		}
+	}
+
+	return layout;
+}
+
+// Switches the render surface size when an unchained program retimes the display
+void Renderer::updateUnchainedLayout()
+{
+	UnchainedLayout layout = decodeUnchainedLayout();
+
+	if (layout.width != unchained.width || layout.height != unchained.height
+		|| layout.rowAddresses != unchained.rowAddresses || layout.splitRow != unchained.splitRow)
+	{
+		unchained = layout;
+		invalidate();
+	}
+
+	if (nativeWidth != unchained.width || nativeHeight != unchained.height)
+	{
+		markScreenModeChanged(unchained.width, unchained.height);
+	}
+}
+
+// Unchained 256 colour line. The packed VRAM already holds each group of four
+// pixels as one word, in pixel order on little endian hosts, so a line is a
+// straight copy of words from the CRTC address, wrapping at the top of the plane
+void Renderer::renderUnchainedLine(LineTarget& target, uint32_t y)
+{
+	const UnchainedLayout& layout = *target.layout;
+	uint8_t* dest = &target.surface->pixels[y * target.surface->pitch];
+	uint8_t panned[MaxSurfaceWidth + 4];
+	uint32_t address, pan;
+
+	if (y >= layout.splitRow)
+	{
+		// Below a line compare match the display restarts at address 0 unpanned
+		address = (y - layout.splitRow) * layout.rowAddresses;
+		pan = 0;
+	}
+	else
+	{
+		address = vm.video.vgapage + y * layout.rowAddresses;
+		pan = (vm.video.VGA_ATTR[0x13] & 7) >> 1;
+	}
+
+	uint32_t words = (layout.width + pan + 3) >> 2;
+	uint8_t* out = pan ? panned : dest;
+
+	while (words)
+	{
+		uint32_t offset = address & 0xFFFF;
+		uint32_t run = 0x10000 - offset < words ? 0x10000 - offset : words;
+		memcpy(out, &vm.video.VRAM[offset], run * sizeof(uint32_t));
+		out += run * sizeof(uint32_t);
+		address += run;
+		words -= run;
+	}
+
+	if (pan)
+	{
+		memcpy(dest, panned + pan, layout.width);
+	}
+}
+
+// Called as the virtual beam reaches each of the 480 visible scanlines. The
+// lines under it are rasterized with the start address, line compare,
+// panning and palette live at that moment, and the frame is handed to the
+// render task whole once the last one is done
+void Renderer::rasterScanline(uint32_t scanline)
+{
+	if (!rasterChain || scanline >= 480)
+		return;
+
+	if (scanline == 0)
+		beginRasterFrame();
+
+	// A frame the mode changed part way through is dropped
+	if (!rasterFrame || lineRenderer != rasterRenderer)
+	{
+		rasterFrame = nullptr;
+		return;
+	}
+
+	uint32_t y0 = scanline * rasterFrame->height / 480;
+	uint32_t y1 = (scanline + 1) * rasterFrame->height / 480;
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		rasterLine(y);
+	}
+
+	if (scanline == 479)
+		publishRasterFrame();
+}
+
+// Starts a frame in the raster chain's back buffer, at the size the mode has
+// as the beam leaves the vertical retrace
+void Renderer::beginRasterFrame()
+{
+	uint32_t width = nativeWidth;
+	uint32_t height = nativeHeight;
+
+	// The render task retimes its own surface for unchained modes, so this
+	// side decodes the layout for itself
+	if (vm.video.vidmode == 0x13)
+	{
+		rasterLayout = decodeUnchainedLayout();
+		width = rasterLayout.width;
+		height = rasterLayout.height;
+	}
+
+	rasterRenderer = lineRenderer;
+	if (!rasterRenderer || width > MaxSurfaceWidth || height > MaxLines)
+	{
+		rasterFrame = nullptr;
+		return;
+	}
+
+	rasterChain->resize(width, height);
+	rasterTarget.surface = rasterChain->getBackBuffer();
+	rasterTarget.width = width;
+	rasterTarget.height = height;
+	rasterTarget.lastExpandedLine = ~0u;
+
+	rasterFrame = &rasterFrames[rasterChain->getBackIndex()];
+	rasterFrame->width = width;
+	rasterFrame->height = height;
+	rasterFrame->number = rasterFrameCount + 1;
+	rasterFrame->colourCount = 0;
+	rasterFrameChanged = false;
+}
+
+// Rasterizes one render surface line and notes whether its pixels or colours
+// differ from the frame published last
+void Renderer::rasterLine(uint32_t y)
+{
+	RasterFrame& frame = *rasterFrame;
+	const RasterFrame* last = rasterLast;
+	const RenderSurface& surface = *rasterTarget.surface;
+
+	if (rasterRenderer == &Renderer::renderCGA2bppLine)
+		updateCGAExpandTable(rasterCGATable, rasterCGAKey);
+
+	(this->*rasterRenderer)(rasterTarget, y);
+
+	bool changed = !last || last->width != frame.width || last->height != frame.height
+		|| memcmp(&surface.pixels[y * surface.pitch], &rasterLastSurface->pixels[y * rasterLastSurface->pitch], frame.width) != 0;
+
+	if (frame.colours)
+	{
+		// Lines drawn with the same colours as the line above share its entry
+		const Palette* palette = vm.video.getCurrentPalette();
+		uint32_t revision = palette->revision;
+
+		if (!frame.colourCount || frame.linePalettes[y - 1] != palette || frame.lineRevisions[y - 1] != revision)
+		{
+			resolvePalette(palette, frame.colours[frame.colourCount++]);
+		}
+
+		frame.lineColours[y] = (uint16_t)(frame.colourCount - 1);
+		frame.linePalettes[y] = palette;
+		frame.lineRevisions[y] = revision;
+
+		if (!changed && (last->linePalettes[y] != palette || last->lineRevisions[y] != revision))
+		{
+			changed = memcmp(frame.colours[frame.lineColours[y]], last->colours[last->lineColours[y]], sizeof(frame.colours[0])) != 0;
+		}
+	}
+
+	frame.changed[y] = changed ? frame.number : last->changed[y];
+	rasterFrameChanged |= changed;
+}
+
+void Renderer::publishRasterFrame()
+{
+	rasterLast = rasterFrame;
+	rasterLastSurface = rasterTarget.surface;
+	rasterFrameCount = rasterFrame->number;
+	rasterFrame = nullptr;
+
+	rasterChain->publish();
+
+	if (rasterFrameChanged)
+	{
+		vm.video.updatedscreen = 1;
+	}
+}
+
+// Render task side. Copies the lines of the newest raster frame that changed
+// since the last one taken into the render surface, and marks them to be drawn
+void Renderer::takeRasterFrame()
+{
+	RenderSurface* surface = rasterChain->acquire();
+	if (!surface)
+		surface = rasterChain->getFrontBuffer();
+
+	const RasterFrame& frame = rasterFrames[rasterChain->getFrontIndex()];
+
+	// Drawn at a size this side has not switched to yet, or has switched away from
+	if (frame.width != nativeWidth || frame.height != nativeHeight)
+		return;
+
+	for (uint32_t y = 0; y < frame.height; y++)
+	{
+		if (frame.changed[y] > rasterTaken)
+		{
+			MemUtils::memcpy(&renderSurface->pixels[y * renderSurface->pitch], &surface->pixels[y * surface->pitch], frame.width);
+			drawLines[y] = 1;
+		}
+	}
+
+	rasterTaken = frame.number;
+	rasterColours = frame.colours ? &frame : nullptr;
+}
+
+void Renderer::markTextDirty(uint32_t x, uint32_t y)
+{
+	if (x < MaxColumns && y < MaxRows)
+	{
+		textModeDirtyFlag[y * vm.video.cols + x] = 1;
 	}
 }
 
@@ -490,241 +1396,236 @@ void Renderer::draw ()
 {
 	//ProfileBlock block(vm.timing, "Renderer::draw");
 
+	if (vm.video.vidmode == 0x13)
+		updateUnchainedLayout();
+
 	if (screenModeChanged)
 	{
 		fb->resize(nativeWidth, nativeHeight);
+		if (swapChain)
+			hostSurface = swapChain->getBackBuffer();
 		createScaleMap();
 		screenModeChanged = false;
+
+		// The next raster frame is copied whole
+		rasterTaken = 0;
 	}
 
+	// Take this frame's dirty lines, leaving writes that land mid-draw for the next one
+	for (unsigned y = 0; y < MaxLines; y++)
 	{
-		//ProfileBlock innerblock(vm.timing, "Renderer::draw inner");
+		drawLines[y] = dirtyLines[y];
+		if (drawLines[y])
+			dirtyLines[y] = 0;
+	}
 
+	{
+		//ProfileBlock innerblock(vm.timing, "Renderer::draw inner");
 
+		rasterColours = nullptr;
 
-		uint8_t* RAM = vm.memory.RAM;
-		uint8_t* portram = vm.ports.portram;
-		uint32_t planemode, chary, charx, vidptr, curpixel, usepal, intensity, x1;
-		uint8_t color;
-		uint32_t x, y;
-		switch (vm.video.vidmode) {
-		case 0:
-		case 1:
-		case 2: //text modes
-		case 3:
-		case 7:
-		case 0x82:
+		if (!vm.video.vidgfxmode)
+		{
 			assert(nativeWidth == 640 && nativeHeight == 400);
-			//nativeWidth = 640;
-			//nativeHeight = 400;
 			renderTextMode();
-			break;
-		case 4:
-		case 5:
-			assert(nativeWidth == 320 && nativeHeight == 200);
-			//nativeWidth = 320;
-			//nativeHeight = 200;
-			usepal = (portram[0x3D9] >> 5) & 1;
-			intensity = ((portram[0x3D9] >> 4) & 1) << 3;
-			for (y = 0; y < 200; y++) {
-				for (x = 0; x < 320; x++) {
-					charx = x;
-					chary = y;
-					vidptr = vm.video.videobase + ((chary >> 1) * 80) + ((chary & 1) * 8192) + (charx >> 2);
-					curpixel = RAM[vidptr];
-					switch (charx & 3) {
-					case 3:
-						curpixel = curpixel & 3;
-						break;
-					case 2:
-						curpixel = (curpixel >> 2) & 3;
-						break;
-					case 1:
-						curpixel = (curpixel >> 4) & 3;
-						break;
-					case 0:
-						curpixel = (curpixel >> 6) & 3;
-						break;
-					}
-					if (vm.video.vidmode == 4) {
-						curpixel = curpixel * 2 + usepal + intensity;
-						if (curpixel == (usepal + intensity))  curpixel = vm.video.cgabg;
-						color = curpixel;
-						renderSurface->set(x, y, color);
-					}
-					else {
-						curpixel = curpixel * 63;
-						color = curpixel;
-						renderSurface->set(x, y, color);
-					}
-				}
-			}
-			break;
-		case 6:
-			assert(nativeWidth == 640 && nativeHeight == 400);
-			//nativeWidth = 640;
-			//nativeHeight = 200;
-			for (y = 0; y < 400; y += 2) {
-				for (x = 0; x < 640; x++) {
-					charx = x;
-					chary = y >> 1;
-					vidptr = vm.video.videobase + ((chary >> 1) * 80) + ((chary & 1) * 8192) + (charx >> 3);
-					curpixel = (RAM[vidptr] >> (7 - (charx & 7))) & 1;
-					color = curpixel * 15;
-					renderSurface->set(x, y, color);
-					renderSurface->set(x, y + 1, color);
-				}
-			}
-			break;
-		case 127:
-			assert(nativeWidth == 720 && nativeHeight == 348);
-			// nativeWidth = 720;
-			// nativeHeight = 348;
-			for (y = 0; y < 348; y++) {
-				for (x = 0; x < 720; x++) {
-					charx = x;
-					chary = y >> 1;
-					vidptr = vm.video.videobase + ((y & 3) << 13) + (y >> 2) * 90 + (x >> 3);
-					curpixel = (RAM[vidptr] >> (7 - (charx & 7))) & 1;
-					if (curpixel)
-						color = 0xf;
-					else
-						color = 0x00;
-					renderSurface->set(x, y, color);
-				}
-			}
-			break;
-		case 0x8: //160x200 16-color (PCjr)
-			assert(nativeWidth == 640 && nativeHeight == 400);
-			// nativeWidth = 640; //fix this
-			// nativeHeight = 400; //part later
-			for (y = 0; y < 400; y++)
-				for (x = 0; x < 640; x++) {
-					vidptr = 0xB8000 + (y >> 2) * 80 + (x >> 3) + ((y >> 1) & 1) * 8192;
-					if (((x >> 1) & 1) == 0) color = RAM[vidptr] >> 4;
-					else color = RAM[vidptr] & 15;
-					renderSurface->set(x, y, color);
-				}
-			break;
-		case 0x9: //320x200 16-color (Tandy/PCjr)
-			assert(nativeWidth == 640 && nativeHeight == 400);
-			// nativeWidth = 640; //fix this
-			// nativeHeight = 400; //part later
-			for (y = 0; y < 400; y++)
-				for (x = 0; x < 640; x++) {
-					vidptr = 0xB8000 + (y >> 3) * 160 + (x >> 2) + ((y >> 1) & 3) * 8192;
-					if (((x >> 1) & 1) == 0) color = RAM[vidptr] >> 4;
-					else color = RAM[vidptr] & 15;
-					renderSurface->set(x, y, color);
-				}
-			break;
-		case 0xD:
-			assert(nativeWidth == 320 && nativeHeight == 200);
-			// nativeWidth = 320;
-			// nativeHeight = 200;
-			for (y = 0; y < 200; y++)
-				for (x = 0; x < 320; x++) {
-					vidptr = y * 40 + (x >> 3);
-					x1 = 7 - (x & 7);
-					color = (vm.video.VRAM[vidptr] >> x1) & 1;
-					color += (((vm.video.VRAM[0x10000 + vidptr] >> x1) & 1) << 1);
-					color += (((vm.video.VRAM[0x20000 + vidptr] >> x1) & 1) << 2);
-					color += (((vm.video.VRAM[0x30000 + vidptr] >> x1) & 1) << 3);
-					renderSurface->set(x, y, color);
-				}
-			break;
-		case 0xE:
-			break;
-		case 0x10:
-			assert(nativeWidth == 640 && nativeHeight == 350);
-			// nativeWidth = 640;
-			// nativeHeight = 350;
-			for (y = 0; y < 350; y++)
-				for (x = 0; x < 640; x++) {
-					vidptr = y * 80 + (x >> 3);
-					x1 = 7 - (x & 7);
-					color = (vm.video.VRAM[vidptr] >> x1) & 1;
-					color |= (((vm.video.VRAM[0x10000 + vidptr] >> x1) & 1) << 1);
-					color |= (((vm.video.VRAM[0x20000 + vidptr] >> x1) & 1) << 2);
-					color |= (((vm.video.VRAM[0x30000 + vidptr] >> x1) & 1) << 3);
-					renderSurface->set(x, y, color);
-				}
-			break;
-		case 0x12:
-			assert(nativeWidth == 640 && nativeHeight == 480);
-			// nativeWidth = 640;
-			// nativeHeight = 480;
-			for (y = 0; y < nativeHeight; y++)
-				for (x = 0; x < nativeWidth; x++) {
-					vidptr = y * 80 + (x / 8);
-					color = (vm.video.VRAM[vidptr] >> (~x & 7)) & 1;
-					color |= ((vm.video.VRAM[vidptr + 0x10000] >> (~x & 7)) & 1) << 1;
-					color |= ((vm.video.VRAM[vidptr + 0x20000] >> (~x & 7)) & 1) << 2;
-					color |= ((vm.video.VRAM[vidptr + 0x30000] >> (~x & 7)) & 1) << 3;
-					renderSurface->set(x, y, color);
-				}
-			break;
-		case 0x13:
-			assert(nativeWidth == 320 && nativeHeight == 200);
-			if (vm.video.vtotal == 11) { //ugly hack to show Flashback at the proper resolution
-				//nativeWidth = 256;
-				//nativeHeight = 224;
-			}
-			else {
-				//nativeWidth = 320;
-				//nativeHeight = 200;
-			}
-			if (vm.video.VGA_SC[4] & 6) 
-				planemode = 1;
-			else 
-				planemode = 0;
-
-			if (!planemode)
+		}
+		else if (rasterChain)
+		{
+			// Lines were already rasterized by rasterScanline as the beam reached
+			// them, so only the ones that changed are drawn
+			MemUtils::memset(drawLines, 0, sizeof(drawLines));
+			takeRasterFrame();
+		}
+		else
+		{
+			liveTarget.lastExpandedLine = ~0u;
+			for (uint32_t y = 0; y < nativeHeight && y < MaxLines; y++)
 			{
-				if (renderSurface->pitch == nativeWidth)
-				{
-					MemUtils::memcpy(renderSurface->pixels, &RAM[vm.video.videobase + ((vm.video.vgapage) & 0xFFFF)], nativeWidth * nativeHeight);
-				}
-				else
-				{
-					for (y = 0; y < nativeHeight; y++)
-					{
-						MemUtils::memcpy(&renderSurface->pixels[y * renderSurface->pitch], &RAM[vm.video.videobase + ((vm.video.vgapage + y*nativeWidth) & 0xFFFF)], nativeWidth);
-					}
-				}
+				if (drawLines[y])
+					renderGraphicsLine(y);
 			}
-			else
+		}
+	}
+
+	if (vm.capture)
+	{
+		vm.capture->captureFrame(*renderSurface, nativeWidth, nativeHeight, drawLines, vm.video.getCurrentPalette());
+	}
+
+	// Raster frames already count colour changes as changed lines
+	if (hostSurface->format == RenderSurface::Format::RGBA8888 && !rasterColours && updatePaletteLUT())
+	{
+		// Every pixel on screen may have changed colour
+		MemUtils::memset(drawLines, 1, sizeof(drawLines));
+	}
+
+	Palette* palette = vm.video.getCurrentPalette();
+	bool paletteChanged = palette != presentedPalette || palette->revision != presentedRevision;
+
+	bool linesChanged = false;
+	for (uint32_t y = 0; y < MaxLines && !linesChanged; y++)
+	{
+		linesChanged = drawLines[y] != 0;
+	}
+
+	// Nothing the host would show differently, so skip the blit and present
+	if (!linesChanged && !paletteChanged)
+		return;
+
+	if (swapChain)
+	{
+		// The back buffer last held a frame from two publishes ago, so it also
+		// needs every line that changed since then
+		uint8_t* backStale = staleLines[swapChain->getBackIndex()];
+		for (uint32_t n = 0; n < SurfaceSwapChain::BufferCount; n++)
+		{
+			for (uint32_t y = 0; y < MaxLines; y++)
 			{
-				for (y = 0; y < nativeHeight; y++)
-				{
-					for (x = 0; x < nativeWidth; x++)
-					{
-						vidptr = y*nativeWidth + x;
-						vidptr = vidptr / 4 + (x & 3) * 0x10000;
-						vidptr = vidptr + vm.video.vgapage - (vm.video.VGA_ATTR[0x13] & 15);
-						color = vm.video.VRAM[vidptr];
-						renderSurface->set(x, y, color);
-					}
-				}
+				staleLines[n][y] |= drawLines[y];
 			}
 		}
+		MemUtils::memcpy(drawLines, backStale, sizeof(drawLines));
+		MemUtils::memset(backStale, 0, MaxLines);
 	}
 
 	if (renderSurface != hostSurface)
 	{
 		if (vm.config.noSmooth)
 		{
-			if (nativeWidth == hostSurface->width && nativeHeight == hostSurface->height)
+			uint32_t xScale = hostSurface->width / nativeWidth;
+			uint32_t yScale = hostSurface->height / nativeHeight;
+
+			if (xScale * nativeWidth != hostSurface->width || yScale * nativeHeight != hostSurface->height
+				|| xScale < 1 || xScale > 4 || yScale < 1 || yScale > 4)
+				roughBlit();
+			else if (xScale == 1 && yScale == 1)
 				simpleBlit();
-			else if (((nativeWidth << 1) == hostSurface->width) && ((nativeHeight << 1) == hostSurface->height))
-				doubleBlit();
 			else
-				roughBlit();
+				integerBlit(xScale, yScale);
 		}
 		else stretchBlit();
 	}
 
-	fb->present();
+	if (paletteChanged)
+	{
+		// Swap chains hand the palette over with the frame instead
+		if (!swapChain)
+			fb->setPalette(palette);
+		presentedPalette = palette;
+		presentedRevision = palette->revision;
+	}
+
+	if (swapChain)
+	{
+		swapChain->publish(hostSurface->format == RenderSurface::Format::Indexed8 ? palette : nullptr);
+		hostSurface = swapChain->getBackBuffer();
+	}
+	else
+	{
+		fb->present();
+	}
+	frameStats.presented++;
+}
+
+// Draws every text cell and the cursor straight from the font, without the
+// glyph atlas or dirty flags the render task uses
+void Renderer::renderTextSnapshot(RenderSurface& target) const
+{
+	uint32_t glyphWidth = 640 / vm.video.cols;
+	uint32_t glyphHeight = 400 / vm.video.rows;
+	const uint8_t* RAM = vm.memory.RAM;
+	const uint8_t* fontData = vm.video.fontcga;
+
+	for (uint32_t row = 0; row < vm.video.rows; row++)
+	{
+		for (uint32_t col = 0; col < vm.video.cols; col++)
+		{
+			uint32_t vidptr = vm.video.vgapage + vm.video.videobase + row * vm.video.cols * 2 + col * 2;
+			const uint8_t* glyph = &fontData[RAM[vidptr] * 128];
+			uint8_t foreground, background;
+			getTextColours(RAM[vidptr + 1], foreground, background);
+
+			for (uint32_t j = 0; j < glyphHeight; j++)
+			{
+				uint8_t* dest = &target.pixels[(row * glyphHeight + j) * target.pitch + col * glyphWidth];
+				const uint8_t* glyphRow = &glyph[(j * 16 / glyphHeight) * 8];
+				for (uint32_t i = 0; i < glyphWidth; i++)
+				{
+					dest[i] = glyphRow[i * 8 / glyphWidth] ? foreground : background;
+				}
+			}
+		}
+	}
+
+	if (vm.video.cursorvisible && cursorX < vm.video.cols && cursorY < vm.video.rows) 
+	{
+		uint32_t curheight = 2;
+		uint32_t x1 = cursorX * glyphWidth;
+		uint32_t y1 = cursorY * 8 + 8 - curheight;
+		uint8_t color = RAM[vm.video.videobase + cursorY * vm.video.cols * 2 + cursorX * 2 + 1] & 15;
+		for (uint32_t y = y1 * 2; y <= y1 * 2 + curheight - 1; y++)
+		{
+			for (uint32_t x = x1; x <= x1 + glyphWidth - 1; x++)
+			{
+				target.set(x, y, color);
+			}
+		}
+	}
+}
+
+// Draws into the caller's buffer through its own LineTarget, so nothing the
+// render task uses is touched and it can keep running on another thread
+bool Renderer::snapshot(uint8_t* pixels, uint32_t pitch, uint32_t maxWidth, uint32_t maxHeight, uint32_t& outWidth, uint32_t& outHeight)
+{
+	UnchainedLayout layout;
+	uint32_t cgaTable[256];
+	uint32_t width = nativeWidth;
+	uint32_t height = nativeHeight;
+
+	if (vm.video.vidmode == 0x13)
+	{
+		layout = decodeUnchainedLayout();
+		width = layout.width;
+		height = layout.height;
+	}
+
+	outWidth = width;
+	outHeight = height;
+
+	if (width > maxWidth || height > maxHeight || height > MaxLines)
+		return false;
+
+	RenderSurface surface;
+	surface.pixels = pixels;
+	surface.width = width;
+	surface.height = height;
+	surface.pitch = pitch;
+
+	if (!vm.video.vidgfxmode)
+	{
+		renderTextSnapshot(surface);
+		return true;
+	}
+
+	LineRenderer renderer = lineRenderer;
+	if (!renderer)
+		return true;
+
+	buildCGAExpandTable(cgaTable);
+
+	LineTarget target;
+	target.surface = &surface;
+	target.layout = &layout;
+	target.cgaTable = cgaTable;
+	target.width = width;
+	target.height = height;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		(this->*renderer)(target, y);
+	}
+
+	return true;
 }
 
 RenderSurface* RenderSurface::create(uint32_t inWidth, uint32_t inHeight)
@@ -742,3 +1643,77 @@ void RenderSurface::destroy(RenderSurface* surface)
 	delete surface;
 }
 
+SurfaceSwapChain::SurfaceSwapChain(uint32_t inMaxWidth, uint32_t inMaxHeight, RenderSurface::Format format)
+	: maxWidth(inMaxWidth), maxHeight(inMaxHeight), width(inMaxWidth), height(inMaxHeight)
+{
+	uint32_t bytesPerPixel = format == RenderSurface::Format::RGBA8888 ? 4 : 1;
+
+	for (uint32_t n = 0; n < BufferCount; n++)
+	{
+		RenderSurface& surface = surfaces[n];
+		surface.width = maxWidth;
+		surface.height = maxHeight;
+		surface.pitch = maxWidth * bytesPerPixel;
+		surface.format = format;
+		surface.pixels = new uint8_t[surface.pitch * maxHeight];
+		MemUtils::memset(surface.pixels, 0, surface.pitch * maxHeight);
+	}
+
+	palettes = new Palette[BufferCount];
+}
+
+SurfaceSwapChain::~SurfaceSwapChain()
+{
+	for (uint32_t n = 0; n < BufferCount; n++)
+	{
+		delete[] surfaces[n].pixels;
+	}
+	delete[] palettes;
+}
+
+void SurfaceSwapChain::resize(uint32_t newWidth, uint32_t newHeight)
+{
+	width = newWidth < maxWidth ? newWidth : maxWidth;
+	height = newHeight < maxHeight ? newHeight : maxHeight;
+}
+
+RenderSurface* SurfaceSwapChain::getBackBuffer()
+{
+	// Only the renderer touches the back buffer, so it can be resized in place
+	RenderSurface& surface = surfaces[back];
+	surface.width = width;
+	surface.height = height;
+	return &surface;
+}
+
+void SurfaceSwapChain::publish(const Palette* palette)
+{
+	if (palette)
+	{
+		if (palette != lastPalette || palette->revision != lastPaletteRevision)
+		{
+			lastPalette = palette;
+			lastPaletteRevision = palette->revision;
+			paletteSerial++;
+		}
+
+		// The buffer only needs a new copy if it last went out with other colours
+		if (paletteSerials[back] != paletteSerial)
+		{
+			palettes[back] = *palette;
+			paletteSerials[back] = paletteSerial;
+		}
+	}
+
+	back = MemUtils::atomicExchange(&pending, back | FreshFlag) & ~FreshFlag;
+}
+
+RenderSurface* SurfaceSwapChain::acquire()
+{
+	if (!(pending & FreshFlag))
+		return nullptr;
+
+	front = MemUtils::atomicExchange(&pending, front) & ~FreshFlag;
+	return &surfaces[front];
+}
+
@@ -21,7 +21,6 @@
 #pragma once
 #include "Types.h"
 #include "TaskManager.h"
-#include "mutex.h"
 
 #ifdef _WIN32
 #include <assert.h>
@@ -30,9 +29,17 @@
 namespace Faux86
 {
 	class VM;
+	class Palette;
+	struct VideoModeInfo;
 
 	struct RenderSurface
 	{
+		enum class Format
+		{
+			Indexed8,	// One palette index per pixel
+			RGBA8888	// 32 bit pixels packed as R << 24 | G << 16 | B << 8 | A
+		};
+
 		static RenderSurface* create(uint32_t inWidth, uint32_t inHeight);
 		static void destroy(RenderSurface* surface);
 
@@ -54,6 +61,58 @@ namespace Faux86
 
 		uint8_t* pixels;
 		uint32_t width, height, pitch;
+		Format format = Format::Indexed8;
+	};
+
+	// Three host surfaces shared by the renderer and a presenter that may run on
+	// another thread. The renderer fills the back buffer and publishes it, the
+	// presenter takes whichever complete frame is newest. Handing a buffer over
+	// is a single atomic exchange, so neither side ever waits or sees a half
+	// drawn frame.
+	class SurfaceSwapChain
+	{
+	public:
+		static constexpr uint32_t BufferCount = 3;
+
+		SurfaceSwapChain(uint32_t maxWidth, uint32_t maxHeight, RenderSurface::Format format);
+		~SurfaceSwapChain();
+
+		// Renderer side. A new size is applied to each buffer as it becomes the back buffer
+		void resize(uint32_t newWidth, uint32_t newHeight);
+		RenderSurface* getBackBuffer();
+		uint32_t getBackIndex() const { return back; }
+
+		// Indexed8 chains pass the palette the frame was drawn with, which travels
+		// with the buffer so an older frame is never shown with newer colours
+		void publish(const Palette* palette = nullptr);
+
+		// Presenter side. Returns nullptr if nothing new was published since the last call
+		RenderSurface* acquire();
+		RenderSurface* getFrontBuffer() { return &surfaces[front]; }
+		uint32_t getFrontIndex() const { return front; }
+
+		// Palette of the front buffer, to apply when presenting it. The serial
+		// changes whenever it differs from the palette of the frame before
+		const Palette* getFrontPalette() const { return &palettes[front]; }
+		uint32_t getFrontPaletteSerial() const { return paletteSerials[front]; }
+
+	private:
+		static constexpr uint32_t FreshFlag = 0x80;
+
+		RenderSurface surfaces[BufferCount];
+		Palette* palettes;
+		uint32_t paletteSerials[BufferCount] = {};
+		uint32_t maxWidth, maxHeight;
+		uint32_t width, height;
+
+		uint32_t back = 0;
+		uint32_t front = 1;
+		volatile uint32_t pending = 2;
+
+		// Renderer side record of the last palette published
+		const Palette* lastPalette = nullptr;
+		uint32_t lastPaletteRevision = 0;
+		uint32_t paletteSerial = 0;
 	};
 
 	class Renderer
@@ -66,28 +125,91 @@ namespace Faux86
 
 		void init();
 		void markScreenModeChanged(uint32_t newWidth, uint32_t newHeight);
+		void setMode(const VideoModeInfo* mode);
 		void draw();
 		void onMemoryWrite(uint32_t address, uint8_t value);
+		void onVRAMWrite(uint32_t offset);
+		void onTextRangeWrite(uint32_t address, uint32_t length);
+		void invalidate();
+		void rasterScanline(uint32_t scanline);
 		void setCursorPosition(uint32_t x, uint32_t y);
 
+		struct FrameStats
+		{
+			uint64_t rendered = 0;		// Frames drawn by the render task
+			uint64_t skipped = 0;		// Frames dropped because emulation was behind real time
+			uint64_t presented = 0;		// Frames that changed the host display
+		};
+		const FrameStats& getFrameStats() const { return frameStats; }
+
+		// With renderOnRequest set, the render task only draws after this is called
+		void requestFrame() { frameRequested = true; }
+
+		// Renders the whole screen as palette indices into a caller buffer, without
+		// waiting for the render task. Changes no renderer state, so the render task
+		// may be drawing on another thread. Fails if the buffer is smaller than the mode
+		bool snapshot(uint8_t* pixels, uint32_t pitch, uint32_t maxWidth, uint32_t maxHeight, uint32_t& outWidth, uint32_t& outHeight);
+
 		RenderSurface* renderSurface = nullptr;
 		RenderSurface* hostSurface = nullptr;
 
 	private:
 		void markTextDirty(uint32_t x, uint32_t y);
+		inline void markLineDirty(uint32_t y)
+		{
+			if (y < MaxLines)
+				dirtyLines[y] = 1;
+		}
 		void refreshTextMode();
-		void renderTextMode();		
+		void renderTextMode();
+		void renderTextSnapshot(RenderSurface& target) const;
+		void getTextColours(uint8_t attr, uint8_t& foreground, uint8_t& background) const;
+		void buildGlyphAtlas(uint32_t glyphWidth, uint32_t glyphHeight);
 		void createScaleMap();
 
+		struct LineTarget;
+		struct UnchainedLayout;
+		void drawPlanarLine(uint8_t* dest, uint32_t vidptr, uint32_t numBytes);
+		void drawPlanarRow(LineTarget& target, uint32_t y, uint32_t row, uint32_t splitRow);
+		uint32_t decodeLineCompare() const;
+		void renderGraphicsLine(uint32_t y);
+		void renderCGA2bppLine(LineTarget& target, uint32_t y);
+		void renderCGA1bppLine(LineTarget& target, uint32_t y);
+		void renderHerculesLine(LineTarget& target, uint32_t y);
+		void renderTandy160Line(LineTarget& target, uint32_t y);
+		void renderTandy320Line(LineTarget& target, uint32_t y);
+		void renderPlanarLine(LineTarget& target, uint32_t y);
+		void renderPlanarDoubledLine(LineTarget& target, uint32_t y);
+		void renderVGA256Line(LineTarget& target, uint32_t y);
+		void buildCGAExpandTable(uint32_t* table) const;
+		void updateCGAExpandTable(uint32_t* table, uint32_t& key);
+		bool copyDoubledLine(LineTarget& target, uint32_t y);
+		UnchainedLayout decodeUnchainedLayout() const;
+		void updateUnchainedLayout();
+		void renderUnchainedLine(LineTarget& target, uint32_t y);
+
+		bool updatePaletteLUT();
+
+		struct RasterFrame;
+		void beginRasterFrame();
+		void rasterLine(uint32_t y);
+		void publishRasterFrame();
+		void takeRasterFrame();
+
+		// Colours of a render surface line on 32 bit hosts. Raster frames carry their own for each line
+		inline const uint32_t* lineLUT(uint32_t y) const
+		{
+			return rasterColours ? rasterColours->colours[rasterColours->lineColours[y]] : paletteLUT;
+		}
+
 		void simpleBlit();
 		void stretchBlit();
 		void roughBlit();
-		void doubleBlit();
+		void integerBlit(uint32_t xScale, uint32_t yScale);
 
 		bool screenModeChanged = false;
 		uint32_t nativeWidth = 640, nativeHeight = 400;
 		//uint8_t prestretch[1024][1024];
-		uint32_t *scalemap = nullptr;
 
 		uint32_t cursorX = 0, cursorY = 0;
 		bool cursorVisible = true;
@@ -96,11 +218,110 @@ namespace Faux86
 		static constexpr unsigned MaxRows = 25;
 		uint8_t textModeDirtyFlag[MaxColumns * MaxRows];
 
+		// Font expanded to the current cell size, one mask byte per pixel
+		uint8_t* glyphAtlas = nullptr;
+		uint32_t atlasGlyphWidth = 0, atlasGlyphHeight = 0;
+		const uint8_t* atlasFont = nullptr;
+
+		// Render surface lines that need rasterizing and blitting on the next
+		// draw, and the set being drawn by the current one
+		static constexpr unsigned MaxLines = 512;
+		uint8_t dirtyLines[MaxLines];
+		uint8_t drawLines[MaxLines];
+
+		// How many host pixels each render surface column, and how many host
+		// rows each line, is stretched over when the scale is not an integer
+		static constexpr unsigned MaxSurfaceWidth = 1024;
+		uint16_t columnRuns[MaxSurfaceWidth];
+		uint16_t rowRuns[MaxLines];
+
+		// Offset into video memory of the row each surface line shows in the
+		// CGA, Hercules and Tandy modes, worked out when the mode is set
+		uint32_t rowOffsets[MaxLines];
+
+		// Line renderer for the current graphics mode, chosen by setMode
+		typedef void (Renderer::*LineRenderer)(LineTarget& target, uint32_t y);
+		LineRenderer lineRenderer = nullptr;
+		uint32_t planarRowBytes = 80;
+
+		// Current 2bpp CGA palette applied to a byte of four pixels
+		uint32_t cgaExpandTable[256];
+		uint32_t cgaExpandKey = ~0u;
+
+		// Display layout of mode 13h as decoded from the CRTC. Unchained ("mode X")
+		// programs can change the resolution, row pitch and split screen line
+		struct UnchainedLayout
+		{
+			uint32_t width = 320, height = 200;
+			uint32_t rowAddresses = 80;		// Plane addresses per displayed row
+			uint32_t splitRow = MaxLines;	// First row drawn from address 0 after a line compare
+		};
+		UnchainedLayout unchained;
+
+		// Where the line renderers draw and the state they carry from line to
+		// line. The render task has its own, and a snapshot builds another so
+		// it never touches anything the render task is using
+		struct LineTarget
+		{
+			RenderSurface* surface = nullptr;
+			const UnchainedLayout* layout = nullptr;
+			const uint32_t* cgaTable = nullptr;
+			uint32_t width = 640, height = 400;
+			uint32_t lastExpandedLine = ~0u;	// Last line of a line doubled mode expanded from video memory
+		};
+		LineTarget liveTarget;
+
+		// Current palette resolved to host RGBA pixels, for 32 bit host surfaces
+		uint32_t paletteLUT[256];
+		const Palette* lutPalette = nullptr;
+		uint32_t lutRevision = 0;
+
+		// Raster mode. The emulation thread rasterizes each line into the back
+		// buffer of its own swap chain as the beam reaches it and publishes the
+		// frame after the last visible scanline, so draw() only ever reads whole
+		// frames. Each buffer has one of these alongside it
+		struct RasterFrame
+		{
+			uint32_t width = 0, height = 0;
+			uint32_t number = 0;					// Frames published before this one, plus one
+			uint32_t changed[MaxLines];				// Number of the frame each line last changed in
+			uint16_t lineColours[MaxLines];			// Entry of colours each line was drawn with
+			const Palette* linePalettes[MaxLines];	// Palette and revision those were resolved from
+			uint32_t lineRevisions[MaxLines];
+			uint32_t (*colours)[256] = nullptr;		// Palettes resolved to RGBA, for 32 bit hosts only
+			uint32_t colourCount = 0;
+		};
+		SurfaceSwapChain* rasterChain = nullptr;
+		RasterFrame* rasterFrames = nullptr;
+
+		// Emulation thread side
+		LineTarget rasterTarget;
+		LineRenderer rasterRenderer = nullptr;
+		UnchainedLayout rasterLayout;
+		uint32_t rasterCGATable[256];
+		uint32_t rasterCGAKey = ~0u;
+		RasterFrame* rasterFrame = nullptr;			// Being rasterized, or null between frames
+		const RasterFrame* rasterLast = nullptr;	// Published last, and its pixels
+		const RenderSurface* rasterLastSurface = nullptr;
+		uint32_t rasterFrameCount = 0;
+		bool rasterFrameChanged = false;
+
+		// Render task side
+		uint32_t rasterTaken = 0;					// Number of the last frame copied to the render surface
+		const RasterFrame* rasterColours = nullptr;	// Frame the blit takes line colours from
+
+		FrameStats frameStats;
+		volatile bool frameRequested = false;
+		const Palette* presentedPalette = nullptr;
+		uint32_t presentedRevision = 0;
+
 		uint64_t totalframes = 0;
 		char windowtitle[128];
 		FrameBufferInterface* fb;
+		SurfaceSwapChain* swapChain = nullptr;
 
-		static Mutex screenMutex;
+		// Render surface lines each swap chain buffer has not been blitted with yet
+		uint8_t staleLines[SurfaceSwapChain::BufferCount][MaxLines];
 
 		VM& vm;
 	};
@@ -114,7 +335,14 @@ namespace Faux86
 		int update() override;
 
 	private:
+		void drawFrame();
+
+		static constexpr uint32_t MaxFrameSkip = 4;
+
 		uint32_t cursorprevtick, cursorcurtick;
+		uint32_t lastRetrace = 0;
+		uint64_t lastFrameTime = 0;
+		uint32_t framesSkipped = 0;
 
 		Renderer& renderer;
 		VM& vm;
@@ -0,0 +1,243 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "DriveManager.h"
+#include "SectorCache.h"
+#include "MemUtils.h"
+
+using namespace Faux86;
+
+SectorCache::~SectorCache()
+{
+	delete[] entries;
+	delete[] data;
+	delete[] buckets;
+	delete[] readBuffer;
+}
+
+void SectorCache::setCapacity(uint32_t sectors)
+{
+	delete[] entries;
+	delete[] data;
+	delete[] buckets;
+	entries = nullptr;
+	data = nullptr;
+	buckets = nullptr;
+
+	if (!readBuffer)
+		readBuffer = new uint8_t[MaxReadAhead * SectorSize];
+
+	capacity = sectors;
+	newest = oldest = NoEntry;
+	freeList = NoEntry;
+	hashMask = 0;
+
+	if (!capacity)
+		return;
+
+	uint32_t bucketCount = 1;
+	while (bucketCount < capacity)
+		bucketCount <<= 1;
+	hashMask = bucketCount - 1;
+
+	entries = new Entry[capacity];
+	data = new uint8_t[capacity * SectorSize];
+	buckets = new uint32_t[bucketCount];
+
+	for (uint32_t n = 0; n < bucketCount; n++)
+		buckets[n] = NoEntry;
+
+	for (uint32_t n = 0; n < capacity; n++)
+	{
+		entries[n].hashNext = n + 1 < capacity ? n + 1 : NoEntry;
+	}
+	freeList = 0;
+}
+
+uint32_t SectorCache::find(uint8_t drive, uint32_t lba) const
+{
+	if (!capacity)
+		return NoEntry;
+
+	for (uint32_t index = buckets[bucketOf(drive, lba)]; index != NoEntry; index = entries[index].hashNext)
+	{
+		if (entries[index].lba == lba && entries[index].drive == drive)
+			return index;
+	}
+
+	return NoEntry;
+}
+
+void SectorCache::unlinkLRU(uint32_t index)
+{
+	Entry& entry = entries[index];
+
+	if (entry.newer != NoEntry)
+		entries[entry.newer].older = entry.older;
+	else
+		newest = entry.older;
+
+	if (entry.older != NoEntry)
+		entries[entry.older].newer = entry.newer;
+	else
+		oldest = entry.newer;
+}
+
+void SectorCache::linkNewest(uint32_t index)
+{
+	Entry& entry = entries[index];
+
+	entry.newer = NoEntry;
+	entry.older = newest;
+	if (newest != NoEntry)
+		entries[newest].newer = index;
+	else
+		oldest = index;
+	newest = index;
+}
+
+// Takes an entry out of the LRU list and its hash chain and puts it on the free list
+void SectorCache::release(uint32_t index)
+{
+	Entry& entry = entries[index];
+	uint32_t* link = &buckets[bucketOf(entry.drive, entry.lba)];
+
+	while (*link != index)
+		link = &entries[*link].hashNext;
+	*link = entry.hashNext;
+
+	unlinkLRU(index);
+
+	entry.hashNext = freeList;
+	freeList = index;
+}
+
+// Returns a new entry for a sector, evicting the least recently used one if full
+uint32_t SectorCache::allocate(uint8_t drive, uint32_t lba)
+{
+	if (freeList == NoEntry)
+	{
+		release(oldest);
+		stats.evictions++;
+	}
+
+	uint32_t index = freeList;
+	Entry& entry = entries[index];
+	freeList = entry.hashNext;
+
+	uint32_t bucket = bucketOf(drive, lba);
+	entry.lba = lba;
+	entry.drive = drive;
+	entry.hashNext = buckets[bucket];
+	buckets[bucket] = index;
+	linkNewest(index);
+
+	return index;
+}
+
+const uint8_t* SectorCache::read(uint8_t drive, DiskInterface* disk, uint32_t lba, uint32_t readAhead)
+{
+	if (!readBuffer)
+		setCapacity(0);
+
+	uint32_t index = find(drive, lba);
+
+	if (index != NoEntry)
+	{
+		stats.hits++;
+		unlinkLRU(index);
+		linkNewest(index);
+		return &data[index * SectorSize];
+	}
+
+	stats.misses++;
+
+	// Read ahead as far as asked, but never past something already cached or
+	// so far that the run would start evicting itself
+	uint32_t count = 1 + readAhead;
+	uint64_t diskSectors = disk->getSize() / SectorSize;
+
+	if (count > MaxReadAhead)
+		count = MaxReadAhead;
+	if (count > (capacity + 1) / 2)
+		count = (capacity + 1) / 2;
+	if (!count)
+		count = 1;	// Uncached, only the sector asked for is kept
+	if (lba >= diskSectors)
+		return nullptr;
+	if (count > diskSectors - lba)
+		count = (uint32_t)(diskSectors - lba);
+	for (uint32_t n = 1; n < count; n++)
+	{
+		if (find(drive, lba + n) != NoEntry)
+		{
+			count = n;
+			break;
+		}
+	}
+
+	disk->seek((uint64_t)lba * SectorSize);
+	int bytesRead = disk->read(readBuffer, count * SectorSize);
+	count = bytesRead > 0 ? (uint32_t)bytesRead / SectorSize : 0;
+
+	if (!count)
+		return nullptr;
+
+	stats.readAheadSectors += count - 1;
+
+	if (!capacity)
+		return readBuffer;
+
+	// Insert the read ahead sectors first so the one asked for ends up newest
+	for (uint32_t n = count; n-- > 0; )
+	{
+		index = allocate(drive, lba + n);
+		MemUtils::memcpy(&data[index * SectorSize], &readBuffer[n * SectorSize], SectorSize);
+	}
+
+	return &data[index * SectorSize];
+}
+
+void SectorCache::update(uint8_t drive, uint32_t lba, const uint8_t* sector)
+{
+	uint32_t index = find(drive, lba);
+
+	if (index != NoEntry)
+	{
+		MemUtils::memcpy(&data[index * SectorSize], sector, SectorSize);
+	}
+}
+
+void SectorCache::invalidate(uint8_t drive)
+{
+	if (!capacity)
+		return;
+
+	// Only entries in use are on the LRU list
+	uint32_t index = newest;
+	while (index != NoEntry)
+	{
+		uint32_t next = entries[index].older;
+		if (entries[index].drive == drive)
+			release(index);
+		index = next;
+	}
+}
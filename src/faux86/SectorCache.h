@@ -0,0 +1,101 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#pragma once
+
+#include "Types.h"
+
+namespace Faux86
+{
+	class DiskInterface;
+
+	// Least recently used cache of 512 byte disk sectors, shared by all drives.
+	// A miss reads the sectors the caller expects to need next along with the
+	// one asked for, so DOS boots and large file loads turn into a few large
+	// host reads instead of a seek and read per sector. Writes go straight to
+	// the disk and the caller updates any cached copy.
+	class SectorCache
+	{
+	public:
+		static constexpr uint32_t SectorSize = 512;
+		static constexpr uint32_t MaxReadAhead = 128;	// Sectors read by a single miss
+
+		struct Stats
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t readAheadSectors = 0;	// Sectors read beyond the one asked for
+			uint64_t evictions = 0;
+		};
+
+		~SectorCache();
+
+		// Drops everything cached and reallocates for a new size. Zero disables
+		// caching, every read then goes to the disk
+		void setCapacity(uint32_t sectors);
+
+		// Returns the sector, reading it and up to readAhead following sectors
+		// on a miss, or nullptr if it is past the end of the disk. The data stays
+		// valid until the next call into the cache
+		const uint8_t* read(uint8_t drive, DiskInterface* disk, uint32_t lba, uint32_t readAhead);
+
+		// Refreshes the cached copy of a sector that was just written to disk
+		void update(uint8_t drive, uint32_t lba, const uint8_t* data);
+
+		// Forgets every sector of a drive, for when its disk changes
+		void invalidate(uint8_t drive);
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		static constexpr uint32_t NoEntry = ~0u;
+
+		struct Entry
+		{
+			uint32_t lba;
+			uint8_t drive;
+			uint32_t hashNext;
+			uint32_t newer, older;		// LRU list, newest at head
+		};
+
+		uint32_t find(uint8_t drive, uint32_t lba) const;
+		uint32_t allocate(uint8_t drive, uint32_t lba);
+		void release(uint32_t index);
+		void unlinkLRU(uint32_t index);
+		void linkNewest(uint32_t index);
+		inline uint32_t bucketOf(uint8_t drive, uint32_t lba) const
+		{
+			return ((lba * 2654435761u) ^ drive) & hashMask;
+		}
+
+		uint32_t capacity = 0;
+		Entry* entries = nullptr;
+		uint8_t* data = nullptr;
+		uint32_t* buckets = nullptr;
+		uint32_t hashMask = 0;
+		uint32_t freeList = NoEntry;	// Chained through hashNext
+		uint32_t newest = NoEntry, oldest = NoEntry;
+
+		// Staging for multi-sector disk reads
+		uint8_t* readBuffer = nullptr;
+
+		Stats stats;
+	};
+}
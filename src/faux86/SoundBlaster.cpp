@@ -18,7 +18,7 @@
   along with this program; if not, write to the Free Software
   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
-/* Functions to emulate a Creative Labs Sound Blaster Pro. */
+/* Functions to emulate a Creative Labs Sound Blaster 16. */
 
 #include "VM.h"
 #include "SoundBlaster.h"
@@ -43,98 +43,130 @@ void SoundBlaster::setsampleticks()
 	sampleticks = vm.timing.getHostFreq() / (uint64_t) samplerate;
 }
 
+uint8_t SoundBlaster::argCount(uint8_t command)
+{
+	if (command >= 0xB0 && command <= 0xCF)
+		return 3;
+
+	switch (command) {
+			case 0x10:
+			case 0x40:
+			case 0xE0:
+			case 0xE4:
+				return 1;
+			case 0x14:
+			case 0x24:
+			case 0x41:
+			case 0x42:
+			case 0x48:
+				return 2;
+		}
+	return 0;
+}
+
+void SoundBlaster::startDMA(uint8_t is16bit, uint8_t autoinit)
+{
+	dma16 = is16bit;
+	useautoinit = autoinit;
+	usingdma = 1;
+	paused8 = paused16 = 0;
+	speakerstate = 1;
+	fifoCount = 0;
+	blockRemaining = (blocksize + 1) * bytesPerSample();
+}
+
 void SoundBlaster::cmd (uint8_t value) 
 {
-	uint8_t recognized = 1;
+	// Collect any argument bytes before running the command
 	if (waitforarg) 
 	{
-			switch (lastcmdval) {
-					case 0x10: //direct 8-bit sample output
-						sample = value;
-						break;
-					case 0x14: //8-bit single block DMA output
-					case 0x24:
-					case 0x91:
-						if (waitforarg == 2) {
-								blocksize = (blocksize & 0xFF00) | (uint32_t) value;
-								waitforarg = 3;
-								return;
-							}
-						else {
-								blocksize = (blocksize & 0x00FF) | ( (uint32_t) value << 8);
-#ifdef DEBUG_BLASTER
-								printf ("[NOTICE] Sound Blaster DSP block transfer size set to %u\n", blocksize);
-#endif
-								usingdma = 1;
-								blockstep = 0;
-								useautoinit = 0;
-								paused8 = 0;
-								speakerstate = 1;
-							}
-						break;
-					case 0x40: //set time constant
-						samplerate = (uint16_t) ( (uint32_t) 1000000 / (uint32_t) (256 - (uint32_t) value) );
-						setsampleticks();
-#ifdef DEBUG_BLASTER
-						printf ("[DEBUG] Sound Blaster time constant received, sample rate = %u\n", samplerate);
-#endif
-						break;
-					case 0x48: //set DSP block transfer size
-						if (waitforarg == 2) {
-								blocksize = (blocksize & 0xFF00) | (uint32_t) value;
-								waitforarg = 3;
-								return;
-							}
-						else {
-								blocksize = (blocksize & 0x00FF) | ( (uint32_t) value << 8);
-								//if (blocksize == 0) blocksize = 65536;
-								blockstep = 0;
+		cmdargs[cmdargpos++] = value;
+		if (--waitforarg) return;
+	}
+	else
+	{
+		lastcmdval = value;
+		cmdargpos = 0;
+		waitforarg = argCount(value);
+		if (waitforarg) return;
+	}
+
+	uint8_t command = lastcmdval;
+
+	if (command >= 0xB0 && command <= 0xCF)
+	{
+		// DSP 4.xx generic I/O: bit 3 selects input, bit 2 auto-init, and
+		// 0xBx commands are 16 bit. The mode byte holds stereo and signed flags.
+		if (command & 0x08)
+		{
+			log(Log, "[NOTICE] Sound Blaster recording is not supported\n");
+			return;
+		}
+		stereo = (cmdargs[0] >> 5) & 1;
+		signeddata = (cmdargs[0] >> 4) & 1;
+		blocksize = (uint32_t) cmdargs[1] | ( (uint32_t) cmdargs[2] << 8);
 #ifdef DEBUG_BLASTER
-								printf ("[NOTICE] Sound Blaster DSP block transfer size set to %u\n", blocksize);
+		printf ("[NOTICE] Sound Blaster DSP4 %u-bit %s transfer, %u samples\n", command < 0xC0 ? 16 : 8, stereo ? "stereo" : "mono", blocksize + 1);
 #endif
-							}
-						break;
-					case 0xE0: //DSP identification for Sound Blaster 2.0 and newer (invert each bit and put in read buffer)
-						bufNewData (~value);
-						break;
-					case 0xE4: //DSP write test, put data value into read buffer
-						bufNewData (value);
-						lasttestval = value;
-						break;
-					default:
-						recognized = 0;
-				}
-			waitforarg--; // = 0;
-			//if (recognized) return;
-			//waitforarg = 0;
-		}
+		startDMA (command < 0xC0, (command >> 2) & 1);
+		return;
+	}
 
-	switch (value) {
-			case 0x10:
-			case 0x40:
-			case 0xE0:
-			case 0xE4:
-				waitforarg = 1;
+	switch (command) {
+			case 0x10: //direct 8-bit sample output
+				output = ( (int16_t) cmdargs[0] - 128) << 8;
 				break;
 
 			case 0x14: //8-bit single block DMA output
 			case 0x24:
-			case 0x48:
-			case 0x91:
-				waitforarg = 2;
+				blocksize = (uint32_t) cmdargs[0] | ( (uint32_t) cmdargs[1] << 8);
+#ifdef DEBUG_BLASTER
+				printf ("[NOTICE] Sound Blaster DSP block transfer size set to %u\n", blocksize);
+#endif
+				stereo = signeddata = 0;
+				startDMA (0, 0);
 				break;
 
 			case 0x1C: //8-bit auto-init DMA output
 			case 0x2C:
-				usingdma = 1;
-				blockstep = 0;
-				useautoinit = 1;
-				paused8 = 0;
-				speakerstate = 1;
+			case 0x90: //high speed variants use the size set by 48h
+				stereo = signeddata = 0;
+				startDMA (0, 1);
+				break;
+
+			case 0x91:
+				stereo = signeddata = 0;
+				startDMA (0, 0);
+				break;
+
+			case 0x40: //set time constant
+				samplerate = (uint16_t) ( (uint32_t) 1000000 / (uint32_t) (256 - (uint32_t) cmdargs[0]) );
+				setsampleticks();
+#ifdef DEBUG_BLASTER
+				printf ("[DEBUG] Sound Blaster time constant received, sample rate = %u\n", samplerate);
+#endif
+				break;
+
+			case 0x41: //set output sample rate, high byte first
+			case 0x42:
+				samplerate = ( (uint16_t) cmdargs[0] << 8) | cmdargs[1];
+				setsampleticks();
+#ifdef DEBUG_BLASTER
+				printf ("[DEBUG] Sound Blaster sample rate = %u\n", samplerate);
+#endif
+				break;
+
+			case 0x48: //set DSP block transfer size
+				blocksize = (uint32_t) cmdargs[0] | ( (uint32_t) cmdargs[1] << 8);
+				if (usingdma && !dma16) blockRemaining = blocksize + 1;
+#ifdef DEBUG_BLASTER
+				printf ("[NOTICE] Sound Blaster DSP block transfer size set to %u\n", blocksize);
+#endif
 				break;
 
 			case 0xD0: //pause 8-bit DMA I/O
 				paused8 = 1;
+				break;
 			case 0xD1: //speaker output on
 				speakerstate = 1;
 				break;
@@ -144,23 +176,42 @@ void SoundBlaster::cmd (uint8_t value)
 			case 0xD4: //continue 8-bit DMA I/O
 				paused8 = 0;
 				break;
+			case 0xD5: //pause 16-bit DMA I/O
+				paused16 = 1;
+				break;
+			case 0xD6: //continue 16-bit DMA I/O
+				paused16 = 0;
+				break;
 			case 0xD8: //get speaker status
 				if (speakerstate) bufNewData (0xFF);
 				else bufNewData (0x00);
 				break;
-			case 0xDA: //exit 8-bit auto-init DMA I/O mode
-				usingdma = 0;
+			case 0xD9: //exit 16-bit auto-init DMA I/O mode after the current block
+			case 0xDA: //exit 8-bit auto-init DMA I/O mode after the current block
+				useautoinit = 0;
+				break;
+			case 0xE0: //DSP identification for Sound Blaster 2.0 and newer (invert each bit and put in read buffer)
+				bufNewData (~cmdargs[0]);
 				break;
 			case 0xE1: //get DSP version info
 				memptr = 0;
 				bufNewData (dspmaj);
 				bufNewData (dspmin);
 				break;
+			case 0xE4: //DSP write test, put data value into read buffer
+				bufNewData (cmdargs[0]);
+				lasttestval = cmdargs[0];
+				break;
 			case 0xE8: //DSP read test
 				memptr = 0;
 				bufNewData (lasttestval);
 				break;
 			case 0xF2: //force 8-bit IRQ
+				irqstatus |= 1;
+				vm.pic.doirq (sbirq);
+				break;
+			case 0xF3: //force 16-bit IRQ
+				irqstatus |= 2;
 				vm.pic.doirq (sbirq);
 				break;
 			case 0xF8: //undocumented command, clears in-buffer and inserts a null byte
@@ -168,10 +219,45 @@ void SoundBlaster::cmd (uint8_t value)
 				bufNewData (0);
 				break;
 			default:
-				if (!recognized)
-				{
-					log(Log, "[NOTICE] Sound Blaster received unhandled command %02Xh\n", value);
-				}
+				log(Log, "[NOTICE] Sound Blaster received unhandled command %02Xh\n", command);
+				break;
+		}
+}
+
+uint8_t SoundBlaster::readMixer()
+{
+	switch (mixerindex) {
+			case 0x80: //IRQ select
+				switch (sbirq) {
+						case 2: return 1;
+						case 5: return 2;
+						case 7: return 4;
+						case 10: return 8;
+					}
+				return 0;
+			case 0x81: //DMA select
+				return (uint8_t) ( (1 << sbdma) | (1 << sbhdma) );
+			case 0x82: //IRQ status
+				return irqstatus;
+		}
+	return mixer[mixerindex];
+}
+
+void SoundBlaster::writeMixer(uint8_t value)
+{
+	switch (mixerindex) {
+			case 0x80:
+				if (value & 1) sbirq = 2;
+				else if (value & 2) sbirq = 5;
+				else if (value & 4) sbirq = 7;
+				else if (value & 8) sbirq = 10;
+				break;
+			case 0x81:
+				if (value & 0x0B) sbdma = (value & 2) ? 1 : (value & 8) ? 3 : 0;
+				if (value & 0xE0) sbhdma = (value & 0x20) ? 5 : (value & 0x40) ? 6 : 7;
+				break;
+			default:
+				mixer[mixerindex] = value;
 				break;
 		}
 }
@@ -193,17 +279,19 @@ bool SoundBlaster::portWriteHandler(uint16_t portnum, uint8_t value)
 				mixerindex = value;
 				break;
 			case 0x5: //mixer data
-				mixer[mixerindex] = value;
+				writeMixer (value);
 				break;
 			case 0x6: //reset port
 				if ( (value == 0x00) && (lastresetval == 0x01) ) {
 						speakerstate = 0;
-						sample = 128;
+						output = 0;
 						waitforarg = 0;
 						memptr = 0;
 						usingdma = 0;
 						blocksize = 65535;
-						blockstep = 0;
+						blockRemaining = 0;
+						fifoCount = 0;
+						irqstatus = 0;
 						bufNewData (0xAA);
 						MemUtils::memset (mixer, 0xEE, sizeof (mixer) );
 #ifdef DEBUG_BLASTER
@@ -214,7 +302,6 @@ bool SoundBlaster::portWriteHandler(uint16_t portnum, uint8_t value)
 				break;
 			case 0xC: //write command/data
 				cmd (value);
-				if (waitforarg != 3) lastcmdval = value;
 				break;
 		}
 
@@ -238,7 +325,7 @@ bool SoundBlaster::portReadHandler (uint16_t portnum, uint8_t& ret)
 			case 0x9:
 				return adlib.portReadHandler(0x389, ret);
 			case 0x5: //mixer data
-				ret = mixer[mixerindex];
+				ret = readMixer();
 				break;
 			case 0xA: //read data
 				if (memptr == 0) {
@@ -250,10 +337,15 @@ bool SoundBlaster::portReadHandler (uint16_t portnum, uint8_t& ret)
 						memptr--;
 					}
 				break;
-			case 0xE: //read-buffer status
+			case 0xE: //read-buffer status, also acknowledges an 8-bit IRQ
+				irqstatus &= ~1;
 				if (memptr > 0) ret = 0x80;
 				else ret = 0x00;
 				break;
+			case 0xF: //acknowledge a 16-bit IRQ
+				irqstatus &= ~2;
+				ret = 0xFF;
+				break;
 			default:
 				ret = 0x00;
 		}
@@ -264,20 +356,78 @@ bool SoundBlaster::portReadHandler (uint16_t portnum, uint8_t& ret)
 	return true;
 }
 
+void SoundBlaster::fillFifo()
+{
+	uint32_t length = blockRemaining < FifoSize ? blockRemaining : FifoSize;
+	uint32_t transferred = vm.dma.readBlock(dma16 ? sbhdma : sbdma, fifo, length);
+
+	// A masked or exhausted DMA channel plays silence but the DSP keeps counting
+	if (transferred < length)
+	{
+		MemUtils::memset(&fifo[transferred], signeddata ? 0 : 128, length - transferred);
+	}
+
+	fifoRead = 0;
+	fifoCount = length;
+	blockRemaining -= length;
+}
+
+int16_t SoundBlaster::popSample()
+{
+	if (fifoCount == 0 && blockRemaining > 0)
+	{
+		fillFifo();
+	}
+	if (fifoCount == 0)
+	{
+		return 0;
+	}
+
+	int16_t value;
+	if (dma16)
+	{
+		value = (int16_t) (fifo[fifoRead] | ( (uint16_t) fifo[fifoRead + 1] << 8) );
+		if (!signeddata) value ^= (int16_t) 0x8000;
+		fifoRead += 2;
+		fifoCount -= 2;
+	}
+	else
+	{
+		value = signeddata ? (int8_t) fifo[fifoRead] : (int16_t) fifo[fifoRead] - 128;
+		value <<= 8;
+		fifoRead++;
+		fifoCount--;
+	}
+	return value;
+}
+
 void SoundBlaster::tick() 
 {
-	if (!usingdma) return;
-	sample = vm.dma.read (sbdma);
-	blockstep++;
-	if (blockstep > blocksize) 
+	if (!usingdma || (dma16 ? paused16 : paused8) ) return;
+
+	// Stereo frames are folded to mono for the mixer
+	if (stereo)
+	{
+		int32_t left = popSample();
+		int32_t right = popSample();
+		output = (int16_t) ( (left + right) >> 1);
+	}
+	else
+	{
+		output = popSample();
+	}
+
+	// The IRQ fires once the last sample of the block has been played
+	if (fifoCount == 0 && blockRemaining == 0) 
 	{
+		irqstatus |= dma16 ? 2 : 1;
 		vm.pic.doirq (sbirq);
 #ifdef DEBUG_BLASTER
 		printf ("[NOTICE] Sound Blaster did IRQ\n");
 #endif
 		if (useautoinit) 
 		{
-			blockstep = 0;
+			blockRemaining = (blocksize + 1) * bytesPerSample();
 		}
 		else 
 		{
@@ -289,7 +439,7 @@ void SoundBlaster::tick()
 int16_t SoundBlaster::generateSample() 
 {
 	if (speakerstate == 0) return (0);
-	else return ( (int16_t) sample - 128);
+	else return (output >> 8);
 }
 
 SoundBlaster::SoundBlaster(VM& inVM, Adlib& inAdlib)
@@ -302,15 +452,15 @@ void SoundBlaster::init()
 	MemUtils::memset(&mem, 0, 1024);
 	MemUtils::memset(&mixer, 0, 256);
 
-	dspmaj = 2; //emulate a Sound Blaster 2.0
-	//dspmaj = 3; //emulate a Sound Blaster Pro
-	dspmin = 0;
+	dspmaj = 4; //emulate a Sound Blaster 16
+	dspmin = 5;
 	sbirq = vm.config.blaster.irq;
-	sbdma = 1;
+	sbdma = vm.config.blaster.dma;
+	sbhdma = vm.config.blaster.highDma;
 
 	//mixer.reg[0x22] = mixer.reg[0x26] = mixer.reg[0x04] = (4 << 5) | (4 << 1);
 	mixer[0x22] = mixer[0x26] = mixer[0x04] = (4 << 5) | (4 << 1);
 
 	uint16_t baseport = vm.config.blaster.port;
-	vm.ports.setPortRedirector(baseport, baseport + 0xE, this);
+	vm.ports.setPortRedirector(baseport, baseport + 0xF, this);
 }
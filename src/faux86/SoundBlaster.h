@@ -47,8 +47,15 @@ namespace Faux86
 
 	private:
 		void cmd(uint8_t value);
+		uint8_t argCount(uint8_t command);
+		void startDMA(uint8_t is16bit, uint8_t autoinit);
 		void bufNewData(uint8_t value);
 		void setsampleticks();
+		void fillFifo();
+		int16_t popSample();
+		uint32_t bytesPerSample() { return dma16 ? 2 : 1; }
+		uint8_t readMixer();
+		void writeMixer(uint8_t value);
 
 		VM& vm;
 		Adlib& adlib;
@@ -62,16 +69,30 @@ namespace Faux86
 		uint8_t lastcmdval = 0;
 		uint8_t lasttestval = 0;
 		uint8_t waitforarg = 0;
+		uint8_t cmdargs[3];
+		uint8_t cmdargpos = 0;
 		uint8_t paused8 = 0;
 		uint8_t paused16 = 0;
-		uint8_t sample = 0;
+		int16_t output = 0;
 		uint8_t sbirq = 0;
 		uint8_t sbdma = 0;
+		uint8_t sbhdma = 0;
+		uint8_t dma16 = 0;
+		uint8_t stereo = 0;
+		uint8_t signeddata = 0;
+		uint8_t irqstatus = 0;
 		uint8_t usingdma = 0;
 		uint8_t maskdma = 0;
 		uint8_t useautoinit = 0;
 		uint32_t blocksize = 0;
-		uint32_t blockstep = 0;
+
+		// DMA data is fetched a span at a time, never past the end of the
+		// current DSP block, and played out from the FIFO at the sample rate
+		static constexpr uint32_t FifoSize = 1024;
+		uint8_t fifo[FifoSize];
+		uint32_t fifoRead = 0;
+		uint32_t fifoCount = 0;
+		uint32_t blockRemaining = 0;
 
 		uint8_t mixer[256];
 		uint8_t mixerindex = 0;
@@ -36,7 +36,7 @@ void TimingScheduler::init()
 
 	lasti8253tick = lastblastertick = lastadlibtick = lastssourcetick = lastsampletick = lastscanlinetick = lasttick = curtick;
 	scanlinetiming = getHostFreq() / 31500;
-	ssourceticks = getHostFreq() / 8000;
+	ssourceticks = getHostFreq() / DisneySoundSource::sampleRate;
 	adlibticks = getHostFreq() / 48000;
 	if (vm.config.enableAudio) sampleticks = getHostFreq() / gensamplerate;
 	else sampleticks = -1;
@@ -53,9 +53,12 @@ void TimingScheduler::tick()
 			curscanline = (curscanline + 1) % 525;
 			if (curscanline > 479) vm.video.port3da = 8;
 			else vm.video.port3da = 0;
+			if (curscanline == 480) retraceCount++;
 			if (curscanline & 1) vm.video.port3da |= 1;
 			pit0counter++;
 			lastscanlinetick = curtick;
+			if (vm.config.rasterMode && vm.video.vidgfxmode)
+				vm.renderer.rasterScanline(curscanline);
 		}
 
 	if (vm.pit.active[0]) { //timer interrupt channel on i8253
@@ -75,12 +78,13 @@ void TimingScheduler::tick()
 			lasti8253tick = curtick;
 		}
 
-	if (curtick >= (lastssourcetick + ssourceticks) ) {
+	// With audio enabled these are clocked by the mixer at their native rates
+	if (!vm.config.enableAudio && curtick >= (lastssourcetick + ssourceticks) ) {
 			vm.soundSource.tick();
 			lastssourcetick = curtick - (curtick - (lastssourcetick + ssourceticks) );
 		}
 
-	if (vm.blaster.samplerate > 0) {
+	if (!vm.config.enableAudio && vm.blaster.samplerate > 0) {
 			if (curtick >= (lastblastertick + vm.blaster.sampleticks) ) {
 					vm.blaster.tick();
 					lastblastertick = curtick - (curtick - (lastblastertick + vm.blaster.sampleticks) );
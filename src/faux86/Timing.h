@@ -39,6 +39,11 @@ namespace Faux86
 		uint64_t getMS();
 		uint64_t getElapsed(uint64_t prevTick);
 		uint64_t getElapsedMS(uint64_t prevTick);
+		uint64_t getCurrentTick() { return curtick; }
+
+		// Number of times the emulated display has entered vertical retrace
+		uint32_t getRetraceCount() const { return retraceCount; }
+		static constexpr uint32_t RetraceRate = 60;
 
 		uint64_t gensamplerate;
 		uint64_t sampleticks;
@@ -49,6 +54,7 @@ namespace Faux86
 		uint64_t lastsampletick, ssourceticks, lastssourcetick, adlibticks, lastadlibtick, lastblastertick;
 
 		uint16_t pit0counter = 65535;
+		uint32_t retraceCount = 0;
 
 		VM& vm;
 	};
@@ -22,6 +22,8 @@
 #include "VM.h"
 #include "DriveManager.h"
 #include "Debugger.h"
+#include "FrameCapture.h"
+#include "MemUtils.h"
 
 using namespace Faux86;
 
@@ -123,12 +125,26 @@ bool VM::init()
 	log(Log, "Based on Fake86 (c)2010-2013 Mike Chambers");
 	log(Log, "[A portable, open-source 8086 PC emulator]");
 
+	Logging::setChannelEnabled(LogVerbose, config.verbose);
+	Logging::setChannelEnabled(LogRaw, config.verbose);
+
 	if (config.enableDebugger)
 	{
 		debugger = new Debugger(*this);
 	}
 
 	renderer.init();
+
+	if (config.captureFile && config.captureFile->isValid())
+	{
+		capture = new FrameCapture(*this, config.captureFile);
+	}
+	else
+	{
+		delete config.captureFile;
+	}
+	config.captureFile = nullptr;	// Owned by the capture from here on
+
 	audio.init();
 
 	adlib.init();
@@ -139,6 +155,11 @@ bool VM::init()
 	mouse.init();
 
 	timing.init();
+	pcSpeaker.init();
+
+#ifdef BENCHMARK_MEMUTILS
+	MemUtils::benchmark(timing);
+#endif
 
 	if (!config.biosFile || !config.biosFile->isValid())
 	{
@@ -181,6 +202,7 @@ bool VM::init()
 		//debugger->addDataBreakpoint(0x487);
 	}
 
+	drives.setCacheSize(config.diskCacheSize * 1024 / SectorCache::SectorSize);
 	drives.insertDisk(DRIVE_A, config.diskDriveA);
 	drives.insertDisk(DRIVE_B, config.diskDriveB);
 	drives.insertDisk(DRIVE_C, config.diskDriveC);
@@ -220,6 +242,11 @@ bool VM::init()
 
 VM::~VM()
 {
+	// The render task writes to the capture, so stop it before the capture goes
+	taskManager.haltAll();
+
+	delete capture;
+	capture = nullptr;
 }
 
 bool VM::simulate()
@@ -232,6 +259,8 @@ bool VM::simulate()
 
 	taskManager.tick();
 
+	Logging::flush();
+
 	return running;
 }
 
@@ -43,6 +43,7 @@
 namespace Faux86
 {
 	class Debugger;
+	class FrameCapture;
 
 	class VM
 	{
@@ -53,6 +54,13 @@ namespace Faux86
 		bool init();
 		bool simulate();
 
+		// Screen scraping for automation. Cheap enough to poll between simulate() calls
+		bool getScreenText(ScreenText& out) { return video.getScreenText(out); }
+		bool snapshotFrame(uint8_t* pixels, uint32_t pitch, uint32_t maxWidth, uint32_t maxHeight, uint32_t& outWidth, uint32_t& outHeight)
+		{
+			return renderer.snapshot(pixels, pitch, maxWidth, maxHeight, outWidth, outHeight);
+		}
+
 		Config config;
 
 		CPU cpu;
@@ -79,6 +87,7 @@ namespace Faux86
 		TaskManager taskManager;
 
 		Debugger* debugger = nullptr;
+		FrameCapture* capture = nullptr;
 
 		bool running;
 
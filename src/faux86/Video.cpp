@@ -35,11 +35,182 @@ uint32_t Video::rgb(uint32_t r, uint32_t g, uint32_t b)
 #endif
 }
 
-void Video::handleInterrupt() 
+// CRT controller registers 0x00-0x18 as the VGA BIOS programs them for mode 13h
+static const uint8_t mode13CRTC[] =
+{
+	0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0xBF, 0x1F, 0x00, 0x41, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x9C, 0x8E, 0x8F, 0x28, 0x40, 0x96, 0xB9, 0xA3, 0xFF
+};
+
+// Modes the BIOS mode set knows about. Surfaces of 400 lines show 200 line modes doubled
+static const VideoModeInfo videoModes[] =
+{
+	//mode  width height cols rows base     clear   pattern flags                                                                                               colour select                   memory map                          renderer
+	{ 0x00, 640, 400, 40, 25, 0xB8000, 0x4000,  0x0700, 0,                                                                                                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Text },
+	{ 0x01, 640, 400, 40, 25, 0xB8000, 0x4000,  0x0700, VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                                            VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Text },
+	{ 0x02, 640, 400, 80, 25, 0xB8000, 0x4000,  0x0700, VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                                            VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Text },
+	{ 0x03, 640, 400, 80, 25, 0xB8000, 0x4000,  0x0700, VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                                            VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Text },
+	{ 0x04, 320, 200, 40, 25, 0xB8000, 0x4000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour,                                                    48,                            VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::CGA2bpp },
+	{ 0x05, 320, 200, 40, 25, 0xB8000, 0x4000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour,                                                    0,                             VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::CGA2bpp },
+	{ 0x06, 640, 400, 80, 25, 0xB8000, 0x4000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::ClearModeControl,                                          VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::CGA1bpp },
+	{ 0x07, 640, 400, 80, 25, 0xB8000, 0x4000,  0x0700, VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                                            VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Text },	// TODO: should be mono
+	{ 0x08, 640, 400, 20, 25, 0xB8000, 0x4000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Tandy160 },
+	{ 0x09, 640, 400, 40, 25, 0xB8000, 0x8000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Tandy320 },
+	{ 0x0D, 320, 200, 40, 25, 0xA0000, 0x10000, 0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Planar,  VideoModeInfo::Render::Planar },
+	{ 0x0E, 640, 400, 80, 25, 0xA0000, 0x10000, 0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Planar,  VideoModeInfo::Render::PlanarDoubled },
+	{ 0x10, 640, 350, 80, 25, 0xA0000, 0x10000, 0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::ClearModeControl,                  VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Planar,  VideoModeInfo::Render::Planar },
+	{ 0x12, 640, 480, 80, 30, 0xA0000, 0x10000, 0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::VGAPalette | VideoModeInfo::ClearModeControl, VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Planar,  VideoModeInfo::Render::Planar },
+	{ 0x13, 320, 200, 40, 25, 0xA0000, 0x10000, 0x0000, VideoModeInfo::Graphics | VideoModeInfo::Colour | VideoModeInfo::VGAPalette | VideoModeInfo::ClearModeControl, VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Chained, VideoModeInfo::Render::VGA256 },
+	{ 0x7F, 720, 348, 90, 25, 0xB8000, 0x4000,  0x0000, VideoModeInfo::Graphics | VideoModeInfo::ClearModeControl,                                          VideoModeInfo::NoColourSelect, VideoModeInfo::MemoryMap::Linear,  VideoModeInfo::Render::Hercules },	// Hercules
+};
+
+const VideoModeInfo* VideoModeInfo::find(uint8_t mode)
+{
+	for (const VideoModeInfo& info : videoModes)
+	{
+		if (info.mode == mode)
+			return &info;
+	}
+	return nullptr;
+}
+
+// Fills length bytes with a repeating character/attribute pair, doubling the
+// filled span with each copy
+static void fillPattern(uint8_t* dest, uint16_t pattern, uint32_t length)
+{
+	if ((pattern & 0xFF) == (pattern >> 8))
+	{
+		MemUtils::memset(dest, pattern & 0xFF, length);
+		return;
+	}
+
+	dest[0] = (uint8_t) pattern;
+	dest[1] = (uint8_t)(pattern >> 8);
+	for (uint32_t filled = 2; filled < length; filled *= 2)
+	{
+		MemUtils::memcpy(dest + filled, dest, filled < length - filled ? filled : length - filled);
+	}
+}
+
+// INT 10h AH=00h. Bit 7 of the mode number asks for video memory to be kept
+void Video::setMode(uint8_t mode)
 {
 	uint8_t* RAM = vm.memory.RAM;
 	uint8_t* portram = vm.ports.portram;
-	uint32_t tempcalc, memloc, n;
+	bool keepMemory = (mode & 0x80) != 0;
+
+	vidmode = mode & 0x7F;
+	modeInfo = VideoModeInfo::find(vidmode);
+
+	VGA_SC[0x4] = 0; //VGA modes are in chained mode by default after a mode switch
+	VGA_CRTC[0xC] = VGA_CRTC[0xD] = 0; //display starts at the top of video memory again
+	vgapage = 0;
+	VGA_CRTC[0x18] = 0xFF; //line compare at its maximum, so the screen is not split
+	VGA_CRTC[0x7] |= 0x10;
+	VGA_CRTC[0x9] |= 0x40;
+	VGA_ATTR[0x13] = 0; //no pel panning
+
+	if (modeInfo)
+	{
+		currentPalette = (modeInfo->flags & VideoModeInfo::VGAPalette) ? &paletteVGA : &paletteCGA;
+		videobase = modeInfo->base;
+		cols = modeInfo->cols;
+		rows = modeInfo->rows;
+		vidcolor = (modeInfo->flags & VideoModeInfo::Colour) ? 1 : 0;
+		vidgfxmode = (modeInfo->flags & VideoModeInfo::Graphics) ? 1 : 0;
+		blankattr = (uint8_t)(modeInfo->clearPattern >> 8);
+
+		if (modeInfo->flags & VideoModeInfo::ClearModeControl)
+			portram[0x3D8] &= 0xFE;
+		if (modeInfo->colourSelect != VideoModeInfo::NoColourSelect)
+			portram[0x3D9] = modeInfo->colourSelect;
+	}
+
+	if (vidmode == 0x13) { //programs that switch to unchained "mode X" only adjust a few of these
+		for (uint32_t n = 0; n < sizeof(mode13CRTC); n++)
+			VGA_CRTC[n] = mode13CRTC[n];
+	}
+
+	RAM[0x449] = vidmode;
+	RAM[0x44A] = (uint8_t) cols;
+	RAM[0x44B] = 0;
+	RAM[0x484] = (uint8_t) (rows - 1);
+	vm.renderer.setCursorPosition(0, 0);
+
+	if (!keepMemory) {
+		MemUtils::memset (&RAM[0xA0000], 0, 0x20000);
+		MemUtils::memset (VRAM, 0, sizeof(VRAM));
+		if (modeInfo)
+			fillPattern(&RAM[modeInfo->base], modeInfo->clearPattern, modeInfo->clearLength);
+	}
+
+	updatePlanarState();
+	vm.renderer.setMode(modeInfo);
+}
+
+// Chooses the handlers Memory uses for the video window. Called on mode sets
+// and whenever the sequencer changes, as that can chain or unchain mode 13h
+void Video::updateMemoryMap()
+{
+	bool planar = false;
+
+	if (modeInfo)
+	{
+		switch (modeInfo->memoryMap)
+		{
+		case VideoModeInfo::MemoryMap::Linear:
+			planar = false;
+			break;
+		case VideoModeInfo::MemoryMap::Planar:
+			planar = true;
+			break;
+		case VideoModeInfo::MemoryMap::Chained:
+			planar = (VGA_SC[4] & 6) != 0;
+			break;
+		}
+	}
+
+	if (planar)
+	{
+		memoryRead = &Video::readPlanar;
+		memoryWrite = &Video::writePlanar;
+	}
+	else
+	{
+		memoryRead = &Video::readLinear;
+		memoryWrite = &Video::writeLinear;
+	}
+}
+
+uint8_t Video::readLinear(uint32_t addr32)
+{
+	return vm.memory.RAM[addr32];
+}
+
+void Video::writeLinear(uint32_t addr32, uint8_t value)
+{
+	vm.memory.RAM[addr32] = value;
+}
+
+// The planes are only mapped at A0000h-AFFFFh, the rest of the window stays RAM
+uint8_t Video::readPlanar(uint32_t addr32)
+{
+	if (addr32 < 0xB0000)
+		return readVGA(addr32 - 0xA0000);
+	return vm.memory.RAM[addr32];
+}
+
+void Video::writePlanar(uint32_t addr32, uint8_t value)
+{
+	if (addr32 < 0xB0000)
+		writeVGA(addr32 - 0xA0000, value);
+	else
+		vm.memory.RAM[addr32] = value;
+}
+
+void Video::handleInterrupt() 
+{
+	uint32_t memloc, n;
 	union CPU::_bytewordregs_& regs = vm.cpu.regs;
 	uint16_t* segregs = vm.cpu.segregs;
 
@@ -47,192 +218,7 @@ void Video::handleInterrupt()
 	switch (regs.byteregs[regah]) { //what video interrupt function?
 			case 0: //set video mode
 				log(LogVerbose, "Set video mode %02Xh\n", regs.byteregs[regal]);
-				VGA_SC[0x4] = 0; //VGA modes are in chained mode by default after a mode switch
-				//regs.byteregs[regal] = 3;
-				switch (regs.byteregs[regal] & 0x7F) {
-						case 0: //40x25 mono text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 40;
-							rows = 25;
-							vidcolor = 0;
-							vidgfxmode = 0;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							break;
-						case 1: //40x25 color text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 40;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 0;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 2: //80x25 mono text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 80;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 0;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 3: //80x25 color text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 80;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 0;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 4:
-						case 5: //40x25 color text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 40;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 1;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							if (regs.byteregs[regal]==4) portram[0x3D9] = 48;
-							else portram[0x3D9] = 0;
-							break;
-						case 6:
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 80;
-							rows = 25;
-							vidcolor = 0;
-							vidgfxmode = 1;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 7: // TODO: 80x25 mono text
-							currentPalette = &paletteCGA;
-							videobase = textbase;
-							cols = 80;
-							rows = 25;
-							//vidcolor = 0;
-							vidcolor = 1;	// should actually be mono
-							vidgfxmode = 0;
-							blankattr = 7;
-							for (tempcalc = videobase; tempcalc<videobase + 16384; tempcalc += 2) {
-								RAM[tempcalc] = 0;
-								RAM[tempcalc + 1] = blankattr;
-							}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 127:
-							currentPalette = &paletteCGA;
-							videobase = 0xB8000;
-							cols = 90;
-							rows = 25;
-							vidcolor = 0;
-							vidgfxmode = 1;
-							for (tempcalc = videobase; tempcalc<videobase+16384; tempcalc++) {
-									RAM[tempcalc] = 0;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 0x9: //320x200 16-color
-							currentPalette = &paletteCGA;
-							videobase = 0xB8000;
-							cols = 40;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 1;
-							blankattr = 0;
-							if ( (regs.byteregs[regal]&0x80) ==0) for (tempcalc = videobase; tempcalc<videobase+65535; tempcalc+=2) {
-										RAM[tempcalc] = 0;
-										RAM[tempcalc+1] = blankattr;
-									}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 0xD: //320x200 16-color
-							currentPalette = &paletteCGA;
-							videobase = 0xA0000;
-							cols = 40;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 1;
-							blankattr = 0;
-							for (tempcalc = videobase; tempcalc<videobase + 65535; tempcalc += 2) {
-								RAM[tempcalc] = 0;
-								RAM[tempcalc + 1] = blankattr;
-							}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-						case 0x12: //640x480 16-color
-						case 0x13: //320x200 256-color
-							currentPalette = &paletteVGA;
-							videobase = 0xA0000;
-							cols = 40;
-							rows = 25;
-							vidcolor = 1;
-							vidgfxmode = 1;
-							blankattr = 0;
-							for (tempcalc = videobase; tempcalc<videobase+65535; tempcalc+=2) {
-									RAM[tempcalc] = 0;
-									RAM[tempcalc+1] = blankattr;
-								}
-							portram[0x3D8] = portram[0x3D8] & 0xFE;
-							break;
-					}
-				vidmode = regs.byteregs[regal] & 0x7F;
-				RAM[0x449] = vidmode;
-				RAM[0x44A] = (uint8_t) cols;
-				RAM[0x44B] = 0;
-				RAM[0x484] = (uint8_t) (rows - 1);
-				vm.renderer.setCursorPosition(0, 0);
-				if ( (regs.byteregs[regal] & 0x80) == 0x00) {
-						MemUtils::memset (&RAM[0xA0000], 0, 0x1FFFF);
-						MemUtils::memset (VRAM, 0, VRAMSize);
-					}
-				switch (vidmode) {
-						case 127: //hercules
-							vm.renderer.markScreenModeChanged(720, 348);
-							break;
-						case 0x12:
-							vm.renderer.markScreenModeChanged(640, 480);
-							break;
-						case 0x13:
-						case 0x4:
-						case 0x5:
-						case 0xD:
-							vm.renderer.markScreenModeChanged(320, 200);
-							break;
-						default:
-							vm.renderer.markScreenModeChanged(640, 400);
-							break;
-					}
+				setMode(regs.byteregs[regal]);
 				break;
 			case 0x10: //VGA DAC functions
 				switch (regs.byteregs[regal]) {
@@ -257,6 +243,267 @@ void Video::handleInterrupt()
 		}
 }
 
+// Unicode code points for each code page 437 character, including the
+// symbols the video ROM font draws for the control codes
+static const uint16_t cp437ToUnicode[256] =
+{
+	0x0020, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022, 0x25D8, 0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C,
+	0x25BA, 0x25C4, 0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8, 0x2191, 0x2193, 0x2192, 0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC,
+	0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, 0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+	0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F,
+	0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x007E, 0x2302,
+	0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+	0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+	0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+	0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+	0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+// Copies the visible text page out as UTF-8 with its attribute bytes.
+// Returns false in graphics modes
+bool Video::getScreenText(ScreenText& out)
+{
+	if (vidgfxmode)
+		return false;
+
+	out.cols = cols < ScreenText::MaxColumns ? cols : ScreenText::MaxColumns;
+	out.rows = rows < ScreenText::MaxRows ? rows : ScreenText::MaxRows;
+	out.cursorX = cursorposition % cols;
+	out.cursorY = cursorposition / cols;
+
+	const uint8_t* RAM = vm.memory.RAM;
+	char* text = out.text;
+
+	for (uint32_t row = 0; row < out.rows; row++)
+	{
+		const uint8_t* cell = &RAM[videobase + vgapage + row * cols * 2];
+
+		for (uint32_t col = 0; col < out.cols; col++)
+		{
+			uint16_t codePoint = cp437ToUnicode[cell[col * 2]];
+			out.attributes[row * out.cols + col] = cell[col * 2 + 1];
+
+			if (codePoint < 0x80)
+			{
+				*text++ = (char) codePoint;
+			}
+			else if (codePoint < 0x800)
+			{
+				*text++ = (char)(0xC0 | (codePoint >> 6));
+				*text++ = (char)(0x80 | (codePoint & 0x3F));
+			}
+			else
+			{
+				*text++ = (char)(0xE0 | (codePoint >> 12));
+				*text++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+				*text++ = (char)(0x80 | (codePoint & 0x3F));
+			}
+		}
+
+		*text++ = '\n';
+	}
+
+	*text = '\0';
+	return true;
+}
+
+// Optional native versions of the BIOS text services, which otherwise run
+// thousands of ROM instructions per character or scroll. Only text modes are
+// handled. Returns false to leave the call to the ROM
+bool Video::handleTextServices()
+{
+	uint8_t* RAM = vm.memory.RAM;
+	union CPU::_bytewordregs_& regs = vm.cpu.regs;
+	uint16_t* segregs = vm.cpu.segregs;
+
+	if (vidgfxmode)
+		return false;
+
+	switch (regs.byteregs[regah])
+	{
+		case 0x06: //scroll window up
+		case 0x07: //scroll window down
+		{
+			int lines = regs.byteregs[regal];
+			scrollText(RAM[0x462] & 7, regs.byteregs[regah] == 0x06 ? lines : -lines, regs.byteregs[regbh],
+				regs.byteregs[regch], regs.byteregs[regcl], regs.byteregs[regdh], regs.byteregs[regdl]);
+			return true;
+		}
+		case 0x0E: //teletype output
+			if (regs.byteregs[regal] == 7) //the ROM sounds the bell
+				return false;
+			teletype(RAM[0x462] & 7, regs.byteregs[regal], false, 0);
+			return true;
+		case 0x13: //write string
+		{
+			uint8_t mode = regs.byteregs[regal];
+			uint8_t page = regs.byteregs[regbh] & 7;
+			uint32_t length = regs.wordregs[regcx];
+			uint32_t str = segregs[reges] * 16 + regs.wordregs[regbp];
+			uint32_t step = (mode & 2) ? 2 : 1;
+			uint32_t n;
+
+			for (n = 0; n < length; n++)
+			{
+				if (vm.memory.readByte(str + n * step) == 7)
+					return false;
+			}
+
+			uint8_t oldCol = RAM[0x450 + page * 2];
+			uint8_t oldRow = RAM[0x451 + page * 2];
+			setTextCursor(page, regs.byteregs[regdl], regs.byteregs[regdh]);
+
+			for (n = 0; n < length; n++)
+			{
+				uint8_t ch = vm.memory.readByte(str + n * step);
+				uint8_t attr = (mode & 2) ? vm.memory.readByte(str + n * step + 1) : regs.byteregs[regbl];
+				teletype(page, ch, true, attr);
+			}
+
+			if (!(mode & 1))
+				setTextCursor(page, oldCol, oldRow);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint32_t Video::textPageAddress(uint8_t page)
+{
+	uint32_t pageSize = vm.memory.RAM[0x44C] | (vm.memory.RAM[0x44D] << 8);
+	if (!pageSize)
+		pageSize = (cols * rows * 2 + 0xFFF) & ~0xFFF;
+	return videobase + page * pageSize;
+}
+
+// Updates the BIOS data area, and the hardware cursor if the page is on screen
+void Video::setTextCursor(uint8_t page, uint8_t col, uint8_t row)
+{
+	uint8_t* RAM = vm.memory.RAM;
+
+	RAM[0x450 + page * 2] = col;
+	RAM[0x451 + page * 2] = row;
+
+	if (page == (RAM[0x462] & 7))
+	{
+		cursorposition = (uint16_t) ((textPageAddress(page) - videobase) / 2 + row * cols + col);
+		VGA_CRTC[0xE] = cursorposition >> 8;
+		VGA_CRTC[0xF] = cursorposition & 0xFF;
+		vm.renderer.setCursorPosition(cursorposition % cols, cursorposition / cols);
+	}
+}
+
+// Scrolls a window of a text page up (positive lines) or down (negative lines),
+// blanking the rows uncovered with attr. Zero lines clears the whole window
+void Video::scrollText(uint8_t page, int lines, uint8_t attr, uint8_t top, uint8_t left, uint8_t bottom, uint8_t right)
+{
+	if (bottom >= rows)
+		bottom = (uint8_t) (rows - 1);
+	if (right >= cols)
+		right = (uint8_t) (cols - 1);
+	if (top > bottom || left > right)
+		return;
+
+	uint32_t address = textPageAddress(page) + (top * cols + left) * 2;
+	uint8_t* window = &vm.memory.RAM[address];
+	uint32_t height = bottom - top + 1;
+	uint32_t spanBytes = (right - left + 1) * 2;
+	uint32_t rowBytes = cols * 2;
+	uint32_t count = lines < 0 ? -lines : lines;
+	uint32_t r, blankStart;
+
+	if (count == 0 || count > height)
+		count = height;
+
+	if (spanBytes == rowBytes)
+	{
+		// Full width windows are contiguous and move in one go
+		if (lines >= 0)
+			MemUtils::memmove(window, window + count * rowBytes, (height - count) * rowBytes);
+		else
+			MemUtils::memmove(window + count * rowBytes, window, (height - count) * rowBytes);
+	}
+	else if (lines >= 0)
+	{
+		for (r = 0; r < height - count; r++)
+			MemUtils::memmove(window + r * rowBytes, window + (r + count) * rowBytes, spanBytes);
+	}
+	else
+	{
+		for (r = height - 1; r >= count; r--)
+			MemUtils::memmove(window + r * rowBytes, window + (r - count) * rowBytes, spanBytes);
+	}
+
+	blankStart = lines >= 0 ? height - count : 0;
+	for (r = blankStart; r < blankStart + count; r++)
+	{
+		uint8_t* cell = window + r * rowBytes;
+		for (uint32_t n = 0; n < spanBytes; n += 2)
+		{
+			cell[n] = ' ';
+			cell[n + 1] = attr;
+		}
+	}
+
+	vm.renderer.onTextRangeWrite(address, (height - 1) * rowBytes + spanBytes);
+}
+
+// Writes a character at the cursor and advances it, following the control
+// characters and scrolling the way the BIOS teletype does
+void Video::teletype(uint8_t page, uint8_t ch, bool useAttr, uint8_t attr)
+{
+	uint8_t* RAM = vm.memory.RAM;
+	uint32_t base = textPageAddress(page);
+	uint8_t col = RAM[0x450 + page * 2];
+	uint8_t row = RAM[0x451 + page * 2];
+
+	switch (ch)
+	{
+		case 7:
+			break;
+		case 8:
+			if (col)
+				col--;
+			break;
+		case 10:
+			row++;
+			break;
+		case 13:
+			col = 0;
+			break;
+		default:
+		{
+			uint32_t address = base + (row * cols + col) * 2;
+			RAM[address] = ch;
+			if (useAttr)
+				RAM[address + 1] = attr;
+			vm.renderer.onTextRangeWrite(address, 2);
+			if (++col >= cols)
+			{
+				col = 0;
+				row++;
+			}
+			break;
+		}
+	}
+
+	if (row >= rows)
+	{
+		// New lines take the attribute of the cell under the cursor
+		row = (uint8_t) (rows - 1);
+		scrollText(page, 1, RAM[base + (row * cols + col) * 2 + 1], 0, 0, row, (uint8_t) (cols - 1));
+	}
+
+	setTextCursor(page, col, row);
+}
+
 Video::Video(VM& inVM)
 	: vm(inVM)
 {
@@ -274,6 +521,7 @@ Video::Video(VM& inVM)
 	MemUtils::memset(VGA_CRTC, 0, sizeof(uint16_t) * 0x100);
 	MemUtils::memset(VGA_SC, 0, sizeof(uint16_t) * 0x100);
 	MemUtils::memset(VGA_GC, 0, sizeof(uint16_t) * 0x100);
+	updatePlanarState();
 	vm.ports.setPortRedirector(0x3B0, 0x3DA, this);
 
 	currentPalette = &paletteCGA;
@@ -590,6 +838,7 @@ bool Video::portWriteHandler(uint16_t portnum, uint8_t value)
 			{
 				flip3c0 = 1;
 				VGA_ATTR[portram[0x3C0]] = value & 255;
+				vm.renderer.invalidate();
 				break;
 			}
 		case 0x3C4: //sequence controller index
@@ -598,6 +847,9 @@ bool Video::portWriteHandler(uint16_t portnum, uint8_t value)
 			break;
 		case 0x3C5: //sequence controller data
 			VGA_SC[portram[0x3C4]] = value & 255;
+			if (portram[0x3C4] == 4)
+				vm.renderer.invalidate();
+			updatePlanarState();
 			/*if (portram[0x3C4] == 2) {
 			printf("VGA_SC[2] = %02X\n", value);
 			}*/
@@ -655,11 +907,24 @@ bool Video::portWriteHandler(uint16_t portnum, uint8_t value)
 				vtotal = value | ( ( (uint16_t) VGA_GC[7] & 1) << 8) | ( ( (VGA_GC[7] & 32) ? 1 : 0) << 9);
 				//printf("Vertical total: %u\n", vtotal);
 			}
-			vgapage = ((uint32_t)VGA_CRTC[0xC] << 8) + (uint32_t)VGA_CRTC[0xD];
+			if (portram[0x3D4] == 0x7 || portram[0x3D4] == 0x9 || portram[0x3D4] == 0x18)
+			{
+				vm.renderer.invalidate(); //line compare may have moved
+			}
+			if (vgapage != (((uint32_t)VGA_CRTC[0xC] << 8) + (uint32_t)VGA_CRTC[0xD]))
+			{
+				vgapage = ((uint32_t)VGA_CRTC[0xC] << 8) + (uint32_t)VGA_CRTC[0xD];
+				vm.renderer.invalidate();
+			}
 
 			break;
 		case 0x3CF:
 			VGA_GC[portram[0x3CE]] = value;
+			updatePlanarState();
+			break;
+		case 0x3D9: //CGA colour select feeds straight into the rendered colour indices
+			portram[portnum] = value;
+			vm.renderer.invalidate();
 			break;
 		default:
 			portram[portnum] = value;
@@ -719,206 +984,155 @@ bool Video::portReadHandler(uint16_t portnum, uint8_t& outValue)
 	return false;
 }
 
-#define shiftVGA(value) {\
-	for (cnt=0; cnt<(VGA_GC[3] & 7); cnt++) {\
-		value = (value >> 1) | ((value & 1) << 7);\
-	}\
+// Expands the low four bits of a plane select register to a byte lane per plane
+static const uint32_t planeBitsToMask[16] =
+{
+	0x00000000, 0x000000FF, 0x0000FF00, 0x0000FFFF,
+	0x00FF0000, 0x00FF00FF, 0x00FFFF00, 0x00FFFFFF,
+	0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFF00FFFF,
+	0xFFFF0000, 0xFFFF00FF, 0xFFFFFF00, 0xFFFFFFFF
+};
+
+template <uint8_t LogicOp>
+static inline uint32_t logicVGA(uint32_t data, uint32_t latch)
+{
+	switch (LogicOp)
+	{
+		case 1: return data & latch;
+		case 2: return data | latch;
+		case 3: return data ^ latch;
+		default: return data;
+	}
+}
+
+// Rebuilds the read and write paths after a sequencer or graphics controller
+// register changes, so readVGA and writeVGA do no register decoding
+void Video::updatePlanarState()
+{
+	static const WriteFunction writeFunctions[4][4] =
+	{
+		{ &Video::writeMode0<0>, &Video::writeMode0<1>, &Video::writeMode0<2>, &Video::writeMode0<3> },
+		{ &Video::writeMode1, &Video::writeMode1, &Video::writeMode1, &Video::writeMode1 },
+		{ &Video::writeMode2<0>, &Video::writeMode2<1>, &Video::writeMode2<2>, &Video::writeMode2<3> },
+		{ &Video::writeMode3<0>, &Video::writeMode3<1>, &Video::writeMode3<2>, &Video::writeMode3<3> }
+	};
+
+	setResetMask = planeBitsToMask[VGA_GC[0] & 15];
+	setResetEnableMask = planeBitsToMask[VGA_GC[1] & 15];
+	rotateCount = VGA_GC[3] & 7;
+	bitMask = (VGA_GC[8] & 0xFF) * 0x01010101u;
+	mapMask = planeBitsToMask[VGA_SC[2] & 15];
+	colourCompareMask = planeBitsToMask[VGA_GC[2] & 15];
+	colourDontCareMask = planeBitsToMask[VGA_GC[7] & 15];
+	writeFunction = writeFunctions[VGA_GC[5] & 3][(VGA_GC[3] >> 3) & 3];
+
+	updateMemoryMap();
+}
+
+inline uint8_t Video::rotateVGA(uint8_t value)
+{
+	return (uint8_t)((value >> rotateCount) | (value << ((8 - rotateCount) & 7)));
 }
 
-#define logicVGA(curval, latchval) {\
-	switch ((VGA_GC[3]>>3) & 3) {\
-		   case 1: curval &= latchval; break;\
-		   case 2: curval |= latchval; break;\
-		   case 3: curval ^= latchval; break;\
-	}\
+inline void Video::storePlanes(uint32_t addr32, uint32_t data)
+{
+	VRAM[addr32] = (VRAM[addr32] & ~mapMask) | (data & mapMask);
+}
+
+// Write mode 0: rotated CPU data, with set/reset substituted on enabled planes
+template <uint8_t LogicOp>
+void Video::writeMode0(uint32_t addr32, uint8_t value)
+{
+	uint32_t data = rotateVGA(value) * 0x01010101u;
+	data = (data & ~setResetEnableMask) | (setResetMask & setResetEnableMask);
+	data = logicVGA<LogicOp>(data, VGA_latch);
+	storePlanes(addr32, (data & bitMask) | (VGA_latch & ~bitMask));
+}
+
+// Write mode 1: the latches are copied straight back
+void Video::writeMode1(uint32_t addr32, uint8_t value)
+{
+	storePlanes(addr32, VGA_latch);
+}
+
+// Write mode 2: each of the low four CPU bits fills its plane
+template <uint8_t LogicOp>
+void Video::writeMode2(uint32_t addr32, uint8_t value)
+{
+	uint32_t data = logicVGA<LogicOp>(planeBitsToMask[value & 15], VGA_latch);
+	storePlanes(addr32, (data & bitMask) | (VGA_latch & ~bitMask));
+}
+
+// Write mode 3: set/reset data, with the rotated CPU data ANDed into the bit mask
+template <uint8_t LogicOp>
+void Video::writeMode3(uint32_t addr32, uint8_t value)
+{
+	uint32_t mask = (rotateVGA(value) & bitMask) * 0x01010101u;
+	uint32_t data = logicVGA<LogicOp>(setResetMask, VGA_latch);
+	storePlanes(addr32, (data & mask) | (VGA_latch & ~mask));
 }
 
 void Video::writeVGA (uint32_t addr32, uint8_t value) 
 {
-	uint32_t planesize;
-	uint8_t curval, tempand, cnt;
 	updatedscreen = 1;
-	planesize = 0x10000;
 	//if (lastmode != VGA_GC[5] & 3) printf("write mode %u\n", VGA_GC[5] & 3);
 	//lastmode = VGA_GC[5] & 3;
 
-	if (addr32 >= planesize)
+	if (addr32 >= PlaneSize)
 	{
 		//log(Log, "%x:%x ", addr32, value);
 		//return;
-		addr32 &= (planesize - 1);
+		addr32 &= (PlaneSize - 1);
 	}
-	//addr32 = addr32 & (planesize - 1);
-
-	switch (VGA_GC[5] & 3) { //get write mode
-			case 0:
-				shiftVGA (value);
-				if (VGA_SC[2] & 1) {
-						if (VGA_GC[1] & 1)
-							if (VGA_GC[0] & 1) curval = 255;
-							else curval = 0;
-						else curval = value;
-						logicVGA (curval, VGA_latch[0]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[0]);
-						curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[0]);
-						VRAM[addr32] = curval;
-					}
-				if (VGA_SC[2] & 2) {
-						if (VGA_GC[1] & 2)
-							if (VGA_GC[0] & 2) curval = 255;
-							else curval = 0;
-						else curval = value;
-						logicVGA (curval, VGA_latch[1]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[1]);
-						curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[1]);
-						VRAM[addr32+planesize] = curval;
-					}
-				if (VGA_SC[2] & 4) {
-						if (VGA_GC[1] & 4)
-							if (VGA_GC[0] & 4) curval = 255;
-							else curval = 0;
-						else curval = value;
-						logicVGA (curval, VGA_latch[2]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[2]);
-						curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[2]);
-						VRAM[addr32+planesize*2] = curval;
-					}
-				if (VGA_SC[2] & 8) {
-						if (VGA_GC[1] & 8)
-							if (VGA_GC[0] & 8) curval = 255;
-							else curval = 0;
-						else curval = value;
-						logicVGA (curval, VGA_latch[3]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[3]);
-						curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[3]);
-						VRAM[addr32+planesize*3] = curval;
-					}
-				break;
-			case 1:
-				if (VGA_SC[2] & 1) VRAM[addr32] = VGA_latch[0];
-				if (VGA_SC[2] & 2) VRAM[addr32+planesize] = VGA_latch[1];
-				if (VGA_SC[2] & 4) VRAM[addr32+planesize*2] = VGA_latch[2];
-				if (VGA_SC[2] & 8) VRAM[addr32+planesize*3] = VGA_latch[3];
-				break;
-			case 2:
-				if (VGA_SC[2] & 1) {
-					
-					curval = value & 1 ? 0xff : 0;
-					logicVGA(curval, VGA_latch[0]);
-					curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[0]);
-					VRAM[addr32] = curval;
-					
-					//if (VGA_GC[1] & 1)
-						//	if (value & 1) curval = 255;
-						//	else curval = 0;
-						//else curval = value;
-						//logicVGA (curval, VGA_latch[0]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[0]);
-						//VRAM[addr32] = curval;
+	vm.renderer.onVRAMWrite(addr32);
 
-
-					}
-				if (VGA_SC[2] & 2) {
-										
-					curval = value & 2 ? 0xff : 0;
-					logicVGA(curval, VGA_latch[1]);
-					curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[1]);
-					VRAM[addr32 + planesize] = curval;
-
-						//if (VGA_GC[1] & 2)
-						//	if (value & 2) curval = 255;
-						//	else curval = 0;
-						//else curval = value;
-						//logicVGA (curval, VGA_latch[1]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[1]);
-						//
-						//						VRAM[addr32+planesize] = curval;
-					}
-				if (VGA_SC[2] & 4) {
-
-					curval = value & 4 ? 0xff : 0;
-					logicVGA(curval, VGA_latch[2]);
-					curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[2]);
-					VRAM[addr32 + 2 * planesize] = curval;
-
-						//if (VGA_GC[1] & 4)
-						//	if (value & 4) curval = 255;
-						//	else curval = 0;
-						//else curval = value;
-						//logicVGA (curval, VGA_latch[2]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[2]);
-						//
-						//VRAM[addr32+planesize*2] = curval;
-					}
-				if (VGA_SC[2] & 8) {
-
-
-					curval = value & 8 ? 0xff : 0;
-					logicVGA(curval, VGA_latch[1]);
-					curval = (VGA_GC[8] & curval) | (~VGA_GC[8] & VGA_latch[3]);
-					VRAM[addr32 + 3 * planesize] = curval;
-
-						//if (VGA_GC[1] & 8)
-						//	if (value & 8) curval = 255;
-						//	else curval = 0;
-						//else curval = value;
-						//logicVGA (curval, VGA_latch[3]);
-						//curval = (~VGA_GC[8] & curval) | (VGA_GC[8] & VGA_latch[3]);
-						//
-						//VRAM[addr32+planesize*3] = curval;
-					}
-				break;
-			case 3:
-				tempand = value & VGA_GC[8];
-				shiftVGA (value);
-				if (VGA_SC[2] & 1) {
-						if (VGA_GC[0] & 1) curval = 255;
-						else curval = 0;
-						//logicVGA (curval, VGA_latch[0]);
-						curval = (~tempand & curval) | (tempand & VGA_latch[0]);
-						VRAM[addr32] = curval;
-					}
-				if (VGA_SC[2] & 2) {
-						if (VGA_GC[0] & 2) curval = 255;
-						else curval = 0;
-						//logicVGA (curval, VGA_latch[1]);
-						curval = (~tempand & curval) | (tempand & VGA_latch[1]);
-						VRAM[addr32+planesize] = curval;
-					}
-				if (VGA_SC[2] & 4) {
-						if (VGA_GC[0] & 4) curval = 255;
-						else curval = 0;
-						//logicVGA (curval, VGA_latch[2]);
-						curval = (~tempand & curval) | (tempand & VGA_latch[2]);
-						VRAM[addr32+planesize*2] = curval;
-					}
-				if (VGA_SC[2] & 8) {
-						if (VGA_GC[0] & 8) curval = 255;
-						else curval = 0;
-						//logicVGA (curval, VGA_latch[3]);
-						curval = (~tempand & curval) | (tempand & VGA_latch[3]);
-						VRAM[addr32+planesize*3] = curval;
-					}
-				break;
-		}
+	(this->*writeFunction)(addr32, value);
 }
 
 uint8_t Video::readVGA (uint32_t addr32) 
 {
-	uint32_t planesize;
-	planesize = 0x10000;
-
-	VGA_latch[0] = VRAM[addr32];
-	VGA_latch[1] = VRAM[addr32+planesize];
-	VGA_latch[2] = VRAM[addr32+planesize*2];
-	VGA_latch[3] = VRAM[addr32+planesize*3];
-	if (VGA_SC[2] & 1) return (VRAM[addr32]);
-	if (VGA_SC[2] & 2) return (VRAM[addr32+planesize]);
-	if (VGA_SC[2] & 4) return (VRAM[addr32+planesize*2]);
-	if (VGA_SC[2] & 8) return (VRAM[addr32+planesize*3]);
+	VGA_latch = VRAM[addr32 & (PlaneSize - 1)];
+
+	if (VGA_GC[5] & 8)
+	{
+		// Read mode 1: bits set where every cared about plane matches the compare colour
+		uint32_t mismatch = (VGA_latch ^ colourCompareMask) & colourDontCareMask;
+		mismatch |= mismatch >> 16;
+		mismatch |= mismatch >> 8;
+		return (uint8_t) ~mismatch;
+	}
+
+	if (VGA_SC[2] & 1) return (uint8_t) VGA_latch;
+	if (VGA_SC[2] & 2) return (uint8_t) (VGA_latch >> 8);
+	if (VGA_SC[2] & 4) return (uint8_t) (VGA_latch >> 16);
+	if (VGA_SC[2] & 8) return (uint8_t) (VGA_latch >> 24);
 	return (0); //this won't be reached, but without it some compilers give a warning
 }
 
+// Writes VRAM out plane by plane, PlaneSize bytes each, as the planes
+// appear to the CPU
+void Video::copyPlanesOut(uint8_t* dest) const
+{
+	for (uint32_t plane = 0; plane < 4; plane++)
+	{
+		for (uint32_t offset = 0; offset < PlaneSize; offset++)
+		{
+			*dest++ = readPlane(plane, offset);
+		}
+	}
+}
+
+void Video::copyPlanesIn(const uint8_t* src)
+{
+	for (uint32_t plane = 0; plane < 4; plane++)
+	{
+		for (uint32_t offset = 0; offset < PlaneSize; offset++)
+		{
+			writePlane(plane, offset, *src++);
+		}
+	}
+}
+
 Palette::Palette()
 {
 	MemUtils::memset(&colours, 0, sizeof(Palette::Entry) * 256);
@@ -43,21 +43,95 @@ namespace Faux86
 
 		inline void set(int index, uint8_t r, uint8_t g, uint8_t b)
 		{
-			colours[index].r = r;
-			colours[index].g = g;
-			colours[index].b = b;
-			colours[index].a = 0xff;
+			Entry& entry = colours[index];
+			if (entry.r != r || entry.g != g || entry.b != b || entry.a != 0xff)
+			{
+				entry.r = r;
+				entry.g = g;
+				entry.b = b;
+				entry.a = 0xff;
+				revision++;
+			}
 		}
 
 		inline void set(int index, const Entry& colour)
 		{
-			colours[index].r = colour.r;
-			colours[index].g = colour.g;
-			colours[index].b = colour.b;
-			colours[index].a = colour.a;
+			Entry& entry = colours[index];
+			if (entry.r != colour.r || entry.g != colour.g || entry.b != colour.b || entry.a != colour.a)
+			{
+				entry = colour;
+				revision++;
+			}
 		}
 
 		Entry colours[256];
+
+		// Bumped whenever an entry actually changes so consumers can cache conversions
+		uint32_t revision = 0;
+	};
+
+	// Contents of the visible text page, decoded for automation and tests
+	struct ScreenText
+	{
+		static constexpr uint32_t MaxColumns = 80;
+		static constexpr uint32_t MaxRows = 50;
+
+		uint32_t cols = 0, rows = 0;
+		uint32_t cursorX = 0, cursorY = 0;
+
+		// Rows separated by '\n', characters mapped from code page 437
+		char text[MaxColumns * MaxRows * 3 + MaxRows + 1];
+		uint8_t attributes[MaxColumns * MaxRows];
+	};
+
+	// Everything a BIOS mode set decides about a video mode, so it is looked
+	// up once rather than tested on every memory access and scanline
+	struct VideoModeInfo
+	{
+		enum Flags
+		{
+			Graphics = 1,
+			Colour = 2,
+			VGAPalette = 4,
+			ClearModeControl = 8,	// Clears bit 0 (80 column text) of port 3D8h
+		};
+
+		// How the CPU sees A0000h-BFFFFh
+		enum class MemoryMap : uint8_t
+		{
+			Linear,		// Plain RAM
+			Planar,		// EGA/VGA planes through the latches at A0000h
+			Chained		// Linear while chain 4 is on, planar when a program unchains it
+		};
+
+		// Which scanline renderer draws the mode
+		enum class Render : uint8_t
+		{
+			Text,
+			CGA2bpp,
+			CGA1bpp,
+			Hercules,
+			Tandy160,
+			Tandy320,
+			Planar,
+			PlanarDoubled,
+			VGA256
+		};
+
+		static constexpr uint8_t NoColourSelect = 0xFF;
+
+		uint8_t mode;
+		uint16_t width, height;		// Render surface size
+		uint8_t cols, rows;
+		uint32_t base;
+		uint32_t clearLength;		// Bytes from base blanked with clearPattern
+		uint16_t clearPattern;		// Character in the low byte, attribute in the high
+		uint8_t flags;
+		uint8_t colourSelect;		// Value for port 3D9h
+		MemoryMap memoryMap;
+		Render render;
+
+		static const VideoModeInfo* find(uint8_t mode);
 	};
 
 	class Video : public PortInterface
@@ -71,7 +145,24 @@ namespace Faux86
 		uint32_t usefullscreen;
 		
 		static constexpr int VRAMSize = 0x40000;
-		uint8_t VRAM[VRAMSize];
+		static constexpr uint32_t PlaneSize = 0x10000;
+
+		// Planar VRAM, interleaved so that the four plane bytes for an address
+		// share one word, with plane N in bits 8N to 8N+7
+		uint32_t VRAM[PlaneSize];
+
+		// Plane-linear view of VRAM, for debugging and save states
+		inline uint8_t readPlane(uint32_t plane, uint32_t offset) const
+		{
+			return (uint8_t)(VRAM[offset & (PlaneSize - 1)] >> (plane * 8));
+		}
+		inline void writePlane(uint32_t plane, uint32_t offset, uint8_t value)
+		{
+			uint32_t& planes = VRAM[offset & (PlaneSize - 1)];
+			planes = (planes & ~(0xFFu << (plane * 8))) | ((uint32_t)value << (plane * 8));
+		}
+		void copyPlanesOut(uint8_t* dest) const;
+		void copyPlanesIn(const uint8_t* src);
 
 		uint8_t cgabg, blankattr, vidgfxmode, vidcolor;
 		uint16_t cols = 80; 
@@ -86,9 +177,19 @@ namespace Faux86
 		uint16_t vtotal = 0;
 
 		void handleInterrupt();
+		bool handleTextServices();
+		bool getScreenText(ScreenText& out);
 		uint8_t readVGA(uint32_t addr32);
 		void writeVGA(uint32_t addr32, uint8_t value);
 
+		// Memory handlers for A0000h-BFFFFh, chosen by updateMemoryMap for the current mode
+		typedef uint8_t (Video::*MemoryReadFunction)(uint32_t addr32);
+		typedef void (Video::*MemoryWriteFunction)(uint32_t addr32, uint8_t value);
+		MemoryReadFunction memoryRead = nullptr;
+		MemoryWriteFunction memoryWrite = nullptr;
+
+		const VideoModeInfo* getModeInfo() const { return modeInfo; }
+
 		virtual bool portWriteHandler(uint16_t portnum, uint8_t value) override;
 		virtual bool portReadHandler(uint16_t portnum, uint8_t& outValue) override;
 
@@ -99,12 +200,43 @@ namespace Faux86
 
 		VM& vm;
 		uint8_t lastmode = 0;
-		uint8_t latchRGB = 0, latchPal = 0, VGA_latch[4], stateDAC = 0;
+		uint8_t latchRGB = 0, latchPal = 0, stateDAC = 0;
 		uint8_t latchReadRGB = 0, latchReadPal = 0;
 		Palette::Entry tempRGB;
 
 		Palette* currentPalette;
 
+		uint32_t textPageAddress(uint8_t page);
+		void setTextCursor(uint8_t page, uint8_t col, uint8_t row);
+		void scrollText(uint8_t page, int lines, uint8_t attr, uint8_t top, uint8_t left, uint8_t bottom, uint8_t right);
+		void teletype(uint8_t page, uint8_t ch, bool useAttr, uint8_t attr);
+
+		void setMode(uint8_t mode);
+		void updateMemoryMap();
+		uint8_t readLinear(uint32_t addr32);
+		void writeLinear(uint32_t addr32, uint8_t value);
+		uint8_t readPlanar(uint32_t addr32);
+		void writePlanar(uint32_t addr32, uint8_t value);
+
+		const VideoModeInfo* modeInfo = nullptr;
+
+		void updatePlanarState();
+		inline uint8_t rotateVGA(uint8_t value);
+		inline void storePlanes(uint32_t addr32, uint32_t data);
+		template <uint8_t LogicOp> void writeMode0(uint32_t addr32, uint8_t value);
+		void writeMode1(uint32_t addr32, uint8_t value);
+		template <uint8_t LogicOp> void writeMode2(uint32_t addr32, uint8_t value);
+		template <uint8_t LogicOp> void writeMode3(uint32_t addr32, uint8_t value);
+
+		// Planar read and write paths derived from the SC/GC registers when they change.
+		// The latches and masks hold one byte lane per plane
+		typedef void (Video::*WriteFunction)(uint32_t addr32, uint8_t value);
+		WriteFunction writeFunction = nullptr;
+		uint32_t VGA_latch = 0;
+		uint32_t setResetMask = 0, setResetEnableMask = 0, bitMask = 0, mapMask = 0;
+		uint32_t colourCompareMask = 0, colourDontCareMask = 0;
+		uint8_t rotateCount = 0;
+
 		Palette paletteVGA;
 		Palette paletteCGA;
 	};
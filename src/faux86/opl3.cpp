@@ -1087,39 +1087,138 @@ static void OPL3_GenerateRhythm2(opl3_chip *chip)
     OPL3_SlotGeneratePhase(channel8->slots[1], phase);
 }
 
+//
+// Idle detection
+//
+
+// A slot is idle once its envelope has fully released and it is not keyed.
+// Its output is then silent and its phase is reset on the next key on, so
+// the whole per-sample pipeline can be skipped for it.
+static Bit8u OPL3_SlotIsIdle(opl3_slot *slot)
+{
+    return slot->eg_gen == envelope_gen_num_off && !slot->key
+        && slot->eg_rout == 0x1ff;
+}
+
+static Bit8u OPL3_SlotSkip(opl3_slot *slot)
+{
+    if (!OPL3_SlotIsIdle(slot))
+    {
+        return 0;
+    }
+    slot->out = 0;
+    slot->fbmod = 0;
+    slot->prout = 0;
+    return 1;
+}
+
+static void OPL3_SlotProcess(opl3_slot *slot)
+{
+    OPL3_SlotCalcFB(slot);
+    OPL3_PhaseGenerate(slot);
+    OPL3_EnvelopeCalc(slot);
+}
+
+static Bit8u OPL3_ChipIsIdle(opl3_chip *chip)
+{
+    Bit8u ii;
+    for (ii = 0; ii < 36; ii++)
+    {
+        if (!OPL3_SlotIsIdle(&chip->slot[ii]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void OPL3_AdvanceTimers(opl3_chip *chip)
+{
+    OPL3_NoiseGenerate(chip);
+
+    if ((chip->timer & 0x3f) == 0x3f)
+    {
+        chip->tremolopos = (chip->tremolopos + 1) % 210;
+    }
+    if (chip->tremolopos < 105)
+    {
+        chip->tremolo = chip->tremolopos >> chip->tremoloshift;
+    }
+    else
+    {
+        chip->tremolo = (210 - chip->tremolopos) >> chip->tremoloshift;
+    }
+
+    if ((chip->timer & 0x3ff) == 0x3ff)
+    {
+        chip->vibpos = (chip->vibpos + 1) & 7;
+    }
+
+    chip->timer++;
+
+    while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
+    {
+        if (!(chip->writebuf[chip->writebuf_cur].reg & 0x200))
+        {
+            break;
+        }
+        chip->writebuf[chip->writebuf_cur].reg &= 0x1ff;
+        OPL3_WriteReg(chip, chip->writebuf[chip->writebuf_cur].reg,
+                      chip->writebuf[chip->writebuf_cur].data);
+        chip->writebuf_cur = (chip->writebuf_cur + 1) % OPL_WRITEBUF_SIZE;
+    }
+    chip->writebuf_samplecnt++;
+}
+
 void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 {
     Bit8u ii;
     Bit8u jj;
+    Bit8u rhythm;
     Bit16s accm;
 
+    if (chip->idle)
+    {
+        // Every slot is silent: only keep the timers, LFOs and noise
+        // generator running so that the next note starts in phase
+        buf[0] = buf[1] = 0;
+        chip->mixbuff[0] = chip->mixbuff[1] = 0;
+        OPL3_AdvanceTimers(chip);
+        return;
+    }
+
     buf[1] = OPL3_ClipSample(chip->mixbuff[1]);
+    rhythm = chip->rhy & 0x20;
 
     for (ii = 0; ii < 12; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
+        if (OPL3_SlotSkip(&chip->slot[ii]))
+        {
+            continue;
+        }
+        OPL3_SlotProcess(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
+    // Rhythm mode derives the percussion phases from slots 13 and 17,
+    // so those slots must keep running even when they are idle
     for (ii = 12; ii < 15; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
+        if (!rhythm && OPL3_SlotSkip(&chip->slot[ii]))
+        {
+            continue;
+        }
+        OPL3_SlotProcess(&chip->slot[ii]);
+        if (!rhythm)
+        {
+            OPL3_SlotGenerate(&chip->slot[ii]);
+        }
     }
 
-    if (chip->rhy & 0x20)
+    if (rhythm)
     {
         OPL3_GenerateRhythm1(chip);
     }
-    else
-    {
-        OPL3_SlotGenerate(&chip->slot[12]);
-        OPL3_SlotGenerate(&chip->slot[13]);
-        OPL3_SlotGenerate(&chip->slot[14]);
-    }
 
     chip->mixbuff[0] = 0;
     for (ii = 0; ii < 18; ii++)
@@ -1134,29 +1233,31 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 15; ii < 18; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
+        if (!rhythm && OPL3_SlotSkip(&chip->slot[ii]))
+        {
+            continue;
+        }
+        OPL3_SlotProcess(&chip->slot[ii]);
+        if (!rhythm)
+        {
+            OPL3_SlotGenerate(&chip->slot[ii]);
+        }
     }
 
-    if (chip->rhy & 0x20)
+    if (rhythm)
     {
         OPL3_GenerateRhythm2(chip);
     }
-    else
-    {
-        OPL3_SlotGenerate(&chip->slot[15]);
-        OPL3_SlotGenerate(&chip->slot[16]);
-        OPL3_SlotGenerate(&chip->slot[17]);
-    }
 
     buf[0] = OPL3_ClipSample(chip->mixbuff[0]);
 
     for (ii = 18; ii < 33; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
+        if (OPL3_SlotSkip(&chip->slot[ii]))
+        {
+            continue;
+        }
+        OPL3_SlotProcess(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
@@ -1173,46 +1274,18 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 33; ii < 36; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
+        if (OPL3_SlotSkip(&chip->slot[ii]))
+        {
+            continue;
+        }
+        OPL3_SlotProcess(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
-    OPL3_NoiseGenerate(chip);
+    // Register writes clear this again, so it only has to be checked here
+    chip->idle = OPL3_ChipIsIdle(chip);
 
-    if ((chip->timer & 0x3f) == 0x3f)
-    {
-        chip->tremolopos = (chip->tremolopos + 1) % 210;
-    }
-    if (chip->tremolopos < 105)
-    {
-        chip->tremolo = chip->tremolopos >> chip->tremoloshift;
-    }
-    else
-    {
-        chip->tremolo = (210 - chip->tremolopos) >> chip->tremoloshift;
-    }
-
-    if ((chip->timer & 0x3ff) == 0x3ff)
-    {
-        chip->vibpos = (chip->vibpos + 1) & 7;
-    }
-
-    chip->timer++;
-
-    while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
-    {
-        if (!(chip->writebuf[chip->writebuf_cur].reg & 0x200))
-        {
-            break;
-        }
-        chip->writebuf[chip->writebuf_cur].reg &= 0x1ff;
-        OPL3_WriteReg(chip, chip->writebuf[chip->writebuf_cur].reg,
-                      chip->writebuf[chip->writebuf_cur].data);
-        chip->writebuf_cur = (chip->writebuf_cur + 1) % OPL_WRITEBUF_SIZE;
-    }
-    chip->writebuf_samplecnt++;
+    OPL3_AdvanceTimers(chip);
 }
 
 void OPL3_GenerateResampled(opl3_chip *chip, Bit16s *buf)
@@ -1280,6 +1353,7 @@ void OPL3_WriteReg(opl3_chip *chip, Bit16u reg, Bit8u v)
 {
     Bit8u high = (reg >> 8) & 0x01;
     Bit8u regm = reg & 0xff;
+    chip->idle = 0;
     switch (regm & 0xf0)
     {
     case 0x00:
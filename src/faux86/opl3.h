@@ -111,6 +111,7 @@ struct _opl3_chip {
     Bit8u tremolopos;
     Bit8u tremoloshift;
     Bit32u noise;
+    Bit8u idle;
     Bit16s zeromod;
     Bit32s mixbuff[2];
     //OPL3L
@@ -0,0 +1,257 @@
+/*
+  Faux86: A portable, open-source 8086 PC emulator.
+  Copyright (C)2018 James Howard
+  Based on Fake86
+  Copyright (C)2010-2013 Mike Chambers
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Converts a frame capture recorded with -capture into a numbered sequence
+// of palette PNG images. Standalone, with no dependencies:
+//
+//   g++ -O2 -o capture2png capture2png.cpp
+//   capture2png session.cap frames/session
+//
+// writes frames/session_00000.png, frames/session_00001.png and so on.
+// The stream layout is described in src/faux86/FrameCapture.h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	uint32_t crcTable[256];
+
+	void buildCrcTable()
+	{
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			crcTable[n] = c;
+		}
+	}
+
+	uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length)
+	{
+		crc = ~crc;
+		for (size_t n = 0; n < length; n++)
+			crc = crcTable[(crc ^ data[n]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void append32BE(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back((uint8_t)(value >> 24));
+		out.push_back((uint8_t)(value >> 16));
+		out.push_back((uint8_t)(value >> 8));
+		out.push_back((uint8_t) value);
+	}
+
+	void writeChunk(FILE* file, const char* type, const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> chunk;
+		append32BE(chunk, (uint32_t) data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		append32BE(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+		fwrite(chunk.data(), 1, chunk.size(), file);
+	}
+
+	// Frames are small enough that stored (uncompressed) deflate blocks are fine
+	bool writePNG(const char* filename, const uint8_t* pixels, uint32_t width, uint32_t height, const uint8_t* palette)
+	{
+		FILE* file = fopen(filename, "wb");
+		if (!file)
+			return false;
+
+		static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		fwrite(signature, 1, sizeof(signature), file);
+
+		std::vector<uint8_t> header;
+		append32BE(header, width);
+		append32BE(header, height);
+		header.push_back(8);	// Bit depth
+		header.push_back(3);	// Indexed colour
+		header.push_back(0);
+		header.push_back(0);
+		header.push_back(0);
+		writeChunk(file, "IHDR", header);
+
+		writeChunk(file, "PLTE", std::vector<uint8_t>(palette, palette + 256 * 3));
+
+		std::vector<uint8_t> raw;
+		raw.reserve((width + 1) * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			raw.push_back(0);	// No filter
+			raw.insert(raw.end(), pixels + y * width, pixels + (y + 1) * width);
+		}
+
+		std::vector<uint8_t> zlib;
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+
+		uint32_t a = 1, b = 0;
+		size_t position = 0;
+		do
+		{
+			size_t length = raw.size() - position;
+			if (length > 0xFFFF)
+				length = 0xFFFF;
+
+			zlib.push_back(position + length == raw.size() ? 1 : 0);
+			zlib.push_back((uint8_t) length);
+			zlib.push_back((uint8_t)(length >> 8));
+			zlib.push_back((uint8_t) ~length);
+			zlib.push_back((uint8_t)(~length >> 8));
+			zlib.insert(zlib.end(), raw.begin() + position, raw.begin() + position + length);
+
+			for (size_t n = position; n < position + length; n++)
+			{
+				a = (a + raw[n]) % 65521;
+				b = (b + a) % 65521;
+			}
+			position += length;
+		} while (position < raw.size());
+
+		append32BE(zlib, (b << 16) | a);
+		writeChunk(file, "IDAT", zlib);
+		writeChunk(file, "IEND", std::vector<uint8_t>());
+
+		fclose(file);
+		return true;
+	}
+
+	bool read(FILE* file, void* data, size_t length)
+	{
+		return fread(data, 1, length, file) == length;
+	}
+
+	bool read16(FILE* file, uint32_t& value)
+	{
+		uint8_t bytes[2];
+		if (!read(file, bytes, 2))
+			return false;
+		value = bytes[0] | (bytes[1] << 8);
+		return true;
+	}
+
+	bool read32(FILE* file, uint32_t& value)
+	{
+		uint8_t bytes[4];
+		if (!read(file, bytes, 4))
+			return false;
+		value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		printf("Usage: capture2png <capture file> <output prefix>\n");
+		return 1;
+	}
+
+	FILE* file = fopen(argv[1], "rb");
+	if (!file)
+	{
+		printf("Could not open %s\n", argv[1]);
+		return 1;
+	}
+
+	char magic[4];
+	uint32_t version, reserved;
+	if (!read(file, magic, 4) || memcmp(magic, "F86V", 4) || !read16(file, version) || !read16(file, reserved) || version != 1)
+	{
+		printf("%s is not a Faux86 capture\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+
+	buildCrcTable();
+
+	uint8_t palette[256 * 3] = { 0 };
+	std::vector<uint8_t> frame;
+	uint32_t width = 0, height = 0;
+	uint32_t frameCount = 0;
+	bool truncated = false;
+
+	uint8_t type;
+	while (read(file, &type, 1))
+	{
+		if (type == 'P')
+		{
+			if (!read(file, palette, sizeof(palette)))
+			{
+				truncated = true;
+				break;
+			}
+		}
+		else if (type == 'F')
+		{
+			uint32_t time, newWidth, newHeight, rowCount;
+			if (!read32(file, time) || !read16(file, newWidth) || !read16(file, newHeight) || !read16(file, rowCount))
+			{
+				truncated = true;
+				break;
+			}
+
+			if (newWidth != width || newHeight != height)
+			{
+				width = newWidth;
+				height = newHeight;
+				frame.assign(width * height, 0);
+			}
+
+			for (uint32_t n = 0; n < rowCount && !truncated; n++)
+			{
+				uint32_t y;
+				if (!read16(file, y) || y >= height || !read(file, frame.data() + y * width, width))
+					truncated = true;
+			}
+			if (truncated)
+				break;
+
+			char filename[1024];
+			snprintf(filename, sizeof(filename), "%s_%05u.png", argv[2], frameCount);
+			if (!writePNG(filename, frame.data(), width, height, palette))
+			{
+				printf("Could not write %s\n", filename);
+				fclose(file);
+				return 1;
+			}
+			frameCount++;
+		}
+		else
+		{
+			printf("Unknown record type %02X, stopping\n", type);
+			break;
+		}
+	}
+
+	if (truncated)
+		printf("Capture ends with an incomplete record, it was ignored\n");
+
+	printf("Wrote %u frames\n", frameCount);
+	fclose(file);
+	return 0;
+}
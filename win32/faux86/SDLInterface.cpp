@@ -27,6 +27,7 @@
 #include "SDLInterface.h"
 #include "StdioDiskInterface.h"
 #include "../../src/faux86/VM.h"
+#include "../../src/faux86/FrameCapture.h"
 #include "../../pi/Keymap.h"
 
 using namespace Faux86;
@@ -80,6 +81,44 @@ DiskInterface* SDLHostSystemInterface::openFile(const char* filename)
 	return new StdioDiskInterface(filename);
 }
 
+DiskInterface* SDLHostSystemInterface::createFile(const char* filename)
+{
+	return new StdioDiskInterface(filename, true);
+}
+
+void SDLHostSystemInterface::startCapture(VM& vm)
+{
+	if (!vm.capture)
+		return;
+
+	captureVM = &vm;
+	captureRunning = true;
+	captureThread = SDL_CreateThread(captureThreadMain, "FrameCapture", this);
+}
+
+void SDLHostSystemInterface::stopCapture()
+{
+	if (captureThread)
+	{
+		captureRunning = false;
+		SDL_WaitThread(captureThread, nullptr);
+		captureThread = nullptr;
+	}
+}
+
+int SDLHostSystemInterface::captureThreadMain(void* data)
+{
+	SDLHostSystemInterface* host = (SDLHostSystemInterface*) data;
+
+	while (host->captureRunning)
+	{
+		host->captureVM->capture->drain();
+		SDL_Delay(10);
+	}
+
+	return 0;
+}
+
 
 void SDLFrameBufferInterface::init(uint32_t desiredWidth, uint32_t desiredHeight)
 {
@@ -92,62 +131,48 @@ void SDLFrameBufferInterface::init(uint32_t desiredWidth, uint32_t desiredHeight
 	SDL_SetWindowTitle(appWindow, "Faux86");
 	SDL_RenderSetLogicalSize(appRenderer, desiredWidth, desiredHeight);
 
-	surface = SDL_CreateRGBSurface(0, desiredWidth, desiredHeight, 8, 0, 0, 0, 0);
-	screenSurface = SDL_CreateRGBSurface(0, desiredWidth, desiredHeight, 32, 0, 0, 0, 0);
-	screenTexture = SDL_CreateTexture(appRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, screenSurface->w, screenSurface->h);
-
-	renderSurface.width = surface->w;
-	renderSurface.pitch = surface->pitch;
-	renderSurface.height = surface->h;
-	renderSurface.pixels = (uint8_t*) surface->pixels;
+	// The renderer resolves the palette itself, so frames are written straight
+	// into 32 bit buffers in the texture's pixel format
+	swapChain = new SurfaceSwapChain(1024, 1024, RenderSurface::Format::RGBA8888);
+	swapChain->resize(desiredWidth, desiredHeight);
 }
 
-void SDLFrameBufferInterface::resize(uint32_t desiredWidth, uint32_t desiredHeight)
+void SDLFrameBufferInterface::createTexture(uint32_t width, uint32_t height)
 {
-	if (renderSurface.width == desiredWidth && renderSurface.height == desiredHeight)
-		return;
+	if (screenTexture)
+		SDL_DestroyTexture(screenTexture);
 
-	SDL_FreeSurface(surface);
-	SDL_FreeSurface(screenSurface);
-	SDL_DestroyTexture(screenTexture);
-
-	surface = SDL_CreateRGBSurface(0, desiredWidth, desiredHeight, 8, 0, 0, 0, 0);
-	screenSurface = SDL_CreateRGBSurface(0, desiredWidth, desiredHeight, 32, 0, 0, 0, 0);
-	screenTexture = SDL_CreateTexture(appRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, screenSurface->w, screenSurface->h);
+	screenTexture = SDL_CreateTexture(appRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+	textureWidth = width;
+	textureHeight = height;
+}
 
-	renderSurface.width = surface->w;
-	renderSurface.pitch = surface->pitch;
-	renderSurface.height = surface->h;
-	renderSurface.pixels = (uint8_t*)surface->pixels;
+void SDLFrameBufferInterface::resize(uint32_t desiredWidth, uint32_t desiredHeight)
+{
+	swapChain->resize(desiredWidth, desiredHeight);
 }
 
 RenderSurface* SDLFrameBufferInterface::getSurface()
 {
-	return &renderSurface;
+	return swapChain->getBackBuffer();
 }
 
 void SDLFrameBufferInterface::setPalette(Palette* palette)
 {
-	SDL_Color colours[256];
-
-	for (int n = 0; n < 256; n++)
-	{
-		colours[n].r = palette->colours[n].r;
-		colours[n].g = palette->colours[n].g;
-		colours[n].b = palette->colours[n].b;
-	}
-	SDL_SetPaletteColors(surface->format->palette, colours, 0, 256);
+	// Pixels arrive with the palette already applied
 }
 
+// Called from the main loop; shows the newest frame the renderer has finished
 void SDLFrameBufferInterface::present() 
 {
-	SDL_BlitSurface(surface, nullptr, screenSurface, nullptr);
+	RenderSurface* frame = swapChain->acquire();
+	if (!frame)
+		return;
 
-	void* pixels;
-	int pitch;
-	SDL_LockTexture(screenTexture, nullptr, &pixels, &pitch);
-	SDL_ConvertPixels(screenSurface->w, screenSurface->h, screenSurface->format->format, screenSurface->pixels, screenSurface->pitch, SDL_PIXELFORMAT_RGBA8888, pixels, pitch);
-	SDL_UnlockTexture(screenTexture);
+	if (frame->width != textureWidth || frame->height != textureHeight)
+		createTexture(frame->width, frame->height);
+
+	SDL_UpdateTexture(screenTexture, nullptr, frame->pixels, frame->pitch);
 
 	SDL_RenderCopy(appRenderer, screenTexture, nullptr, nullptr);
 	SDL_RenderPresent(appRenderer);
@@ -418,6 +443,8 @@ void SDLHostSystemInterface::tick(VM& vm)
 	SDL_Event event;
 	int mx = 0, my = 0;
 
+	frameBufferInterface.present();
+
 	if (SDL_PollEvent(&event)) 
 	{
 		switch (event.type) {
@@ -473,7 +500,7 @@ void SDLHostSystemInterface::tick(VM& vm)
 
 }
 
-void Faux86::log(Faux86::LogChannel channel, const char* message, ...)
+void Faux86::hostLog(Faux86::LogChannel channel, const char* message, ...)
 {
 	const bool enableLogRaw = false;
 
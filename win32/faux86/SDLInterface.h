@@ -26,7 +26,7 @@
 struct SDL_Window;
 struct SDL_Renderer;
 struct SDL_Texture;
-struct SDL_Surface;
+struct SDL_Thread;
 
 namespace Faux86
 {
@@ -42,16 +42,18 @@ namespace Faux86
 
 		virtual void setPalette(Palette* palette) override;
 
+		virtual SurfaceSwapChain* getSwapChain() override { return swapChain; }
 		virtual void present() override;
 
 		SDL_Window* appWindow;
 	private:
+		void createTexture(uint32_t width, uint32_t height);
+
 		SDL_Renderer* appRenderer;
-		SDL_Surface* surface;
-		SDL_Surface* screenSurface;
-		SDL_Texture* screenTexture;
+		SDL_Texture* screenTexture = nullptr;
+		uint32_t textureWidth = 0, textureHeight = 0;
 
-		RenderSurface renderSurface;
+		SurfaceSwapChain* swapChain = nullptr;
 	};
 
 	class SDLTimerInterface : public TimerInterface
@@ -81,11 +83,21 @@ namespace Faux86
 		virtual FrameBufferInterface& getFrameBuffer() override { return frameBufferInterface; }
 		virtual TimerInterface& getTimer() override { return timerInterface;  }
 		virtual DiskInterface* openFile(const char* filename) override;
+		virtual DiskInterface* createFile(const char* filename) override;
 
 		void tick(VM& vm);
 
+		// Writes frame capture data out from a background thread while the VM runs
+		void startCapture(VM& vm);
+		void stopCapture();
+
 	private:
 		uint8_t translatescancode(uint16_t keyval);
+		static int captureThreadMain(void* data);
+
+		SDL_Thread* captureThread = nullptr;
+		VM* captureVM = nullptr;
+		volatile bool captureRunning = false;
 
 		SDLAudioInterface audioInterface;
 		SDLFrameBufferInterface frameBufferInterface;
@@ -22,9 +22,9 @@
 
 using namespace Faux86;
 
-StdioDiskInterface::StdioDiskInterface(const char* filename)
+StdioDiskInterface::StdioDiskInterface(const char* filename, bool create)
 {
-	fopen_s(&diskFile, filename, "r+b");
+	fopen_s(&diskFile, filename, create ? "w+b" : "r+b");
 
 	if (diskFile)
 	{
@@ -28,7 +28,7 @@ namespace Faux86
 	class StdioDiskInterface : public DiskInterface
 	{
 	public:
-		StdioDiskInterface(const char* filename);
+		StdioDiskInterface(const char* filename, bool create = false);
 		virtual ~StdioDiskInterface();
 		virtual int read(uint8_t *buffer, unsigned count) override;
 		virtual int write(const uint8_t *buffer, unsigned count) override;
@@ -52,11 +52,15 @@ int main(int argc, char *argv[])
 
 	if (f86->init())
 	{
+		hostInterface.startCapture(*f86);
+
 		while (f86->simulate())
 		{
 			hostInterface.tick(*f86);
 			//Sleep(0);
 		}
+
+		hostInterface.stopCapture();
 	}
 
 	delete f86;